@@ -295,7 +295,7 @@ public:
 	bool		m_done;
 	int		m_bomb;
 
-	BUSMASTER_TB(void) : PIPECMDR(FPGAPORT), m_uart(FPGAPORT+1) {
+	BUSMASTER_TB(void) : PIPECMDR(FPGAPORT, FPGAUNIX, FPGASHM), m_uart(FPGAPORT+1) {
 		m_start_time = time(NULL);
 		m_last_pic = 0;
 		m_last_tx_state = 0;
@@ -46,11 +46,13 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <poll.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 
 #include "testb.h"
+#include "shmlink.h"
 
 #define	PIPEBUFLEN	256
 
@@ -67,6 +69,12 @@
 // #define	UARTLEN		8 // Minimum ticks per character
 #define	UARTLEN		4096	//
 
+// How many ticks go by between checks that our shared memory client is
+// still alive, and how long (in 20us naps) we'll wait on that client to make
+// room for our responses before giving up on it
+#define	SHM_REAP_TICKS	(1<<20)
+#define	SHM_SEND_NAPS	100000
+
 template <class VA>	class	PIPECMDR : public TESTB<VA> {
 	void	setup_listener(const int port) {
 		struct	sockaddr_in	my_addr;
@@ -107,15 +115,152 @@ template <class VA>	class	PIPECMDR : public TESTB<VA> {
 		}
 	}
 
+	// Listen for local connections via a Unix domain socket as well
+	void	setup_unix_listener(const char *path) {
+		struct	sockaddr_un	my_addr;
+
+		printf("Listening on %s\n", path);
+
+		m_uskt = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (m_uskt < 0) {
+			perror("Could not allocate socket: ");
+			exit(EXIT_FAILURE);
+		}
+
+		memset(&my_addr, 0, sizeof(my_addr));
+		my_addr.sun_family = AF_UNIX;
+		strncpy(my_addr.sun_path, path, sizeof(my_addr.sun_path)-1);
+
+		unlink(path);
+		if (bind(m_uskt, (struct sockaddr *)&my_addr, sizeof(my_addr))!=0) {
+			perror("BIND FAILED:");
+			exit(EXIT_FAILURE);
+		}
+
+		if (listen(m_uskt, 1) != 0) {
+			perror("Listen failed:");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Accept a connection from skt, if one is waiting
+	void	try_accept(int skt) {
+		struct	pollfd	pb;
+
+		if ((m_con >= 0)||(m_shm_con)||(skt < 0))
+			return;
+
+		pb.fd = skt;
+		pb.events = POLLIN;
+		poll(&pb, 1, 0);
+
+		if (pb.revents & POLLIN) {
+			m_con = accept(skt, 0, 0);
+
+			if (m_con < 0)
+				perror("Accept failed:");
+		}
+	}
+
+	// Notice a client attaching to, or detaching from, our shared memory.
+	// Every so often, also check that the client hasn't exited without
+	// detaching, lest the link remain in use until we restart.
+	void	check_shm(void) {
+		pid_t	pid;
+
+		if (!m_shm)
+			return;
+		pid = __atomic_load_n(&m_shm->m_client, __ATOMIC_ACQUIRE);
+		if ((pid != 0)&&(++m_shm_ticks >= SHM_REAP_TICKS)) {
+			m_shm_ticks = 0;
+			if (shmlink_reap(m_shm))
+				pid = 0;
+		}
+
+		if ((m_shm_con)&&(pid != m_shmpid))
+			close_con();
+		if ((!m_shm_con)&&(pid != 0)&&(m_con < 0)) {
+			m_shm_con = true;
+			m_shmpid = pid;
+		}
+	}
+
+	void	close_con(void) {
+		if (m_shm_con) {
+			pid_t	pid = m_shmpid;
+
+			// Leave be any new client that's taken its place
+			if (__atomic_load_n(&m_shm->m_client, __ATOMIC_ACQUIRE)
+					== pid)
+				m_shm->m_tofpga.drain();
+			__atomic_compare_exchange_n(&m_shm->m_client, &pid, 0,
+				false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+			m_shm_con = false;
+			m_shmpid = 0;
+		} else if (m_con >= 0) {
+			close(m_con);
+			m_con = -1;
+		}
+	}
+
+	// Send our transmit buffer across the shared memory link.  Should the
+	// client fall behind, we wait for it to make room, rather than drop
+	// anything and leave it unable to decode what follows.  Returns the
+	// number of bytes sent.
+	int	shm_send(void) {
+		unsigned	naps = 0;
+		int		snt = 0;
+
+		while(snt < m_txpos) {
+			snt += m_shm->m_fromfpga.write(&m_txbuf[snt],
+					m_txpos-snt);
+			if (snt >= m_txpos)
+				break;
+			if ((__atomic_load_n(&m_shm->m_client, __ATOMIC_ACQUIRE)
+						!= m_shmpid)
+					||(shmlink_reap(m_shm))
+					||(++naps > SHM_SEND_NAPS)) {
+				// It's either gone, or stopped listening
+				close_con();
+				break;
+			} usleep(20);
+		}
+
+		return snt;
+	}
+
+	bool	connected(void) const {
+		return (m_con > 0)||(m_shm_con);
+	}
+
 public:
-	int	m_skt, m_con;
+	int	m_skt, m_uskt, m_con;
+	SHMLINK	*m_shm;
+	const char	*m_upath, *m_shmname;
+	bool	m_shm_con;
+	pid_t	m_shmpid;
+	unsigned	m_shm_ticks;
 	char	m_txbuf[PIPEBUFLEN], m_rxbuf[PIPEBUFLEN];
 	int	m_ilen, m_rxpos, m_txpos, m_uart_wait, m_tx_busy;
 	bool	m_started_flag;
 
-	PIPECMDR(const int port) : TESTB<VA>() {
-		m_con = m_skt = -1;
+	// Besides the TCP port, we may also listen on a Unix domain socket
+	// (upath), and offer a shared memory link (shmname), so long as the
+	// client is on this same machine.
+	PIPECMDR(const int port, const char *upath = NULL,
+			const char *shmname = NULL) : TESTB<VA>() {
+		m_con = m_skt = m_uskt = -1;
+		m_shm = NULL;
+		m_shm_con = false;
+		m_shmpid = 0;
+		m_shm_ticks = 0;
+		m_upath = upath;
+		m_shmname = shmname;
 		setup_listener(port);
+		if (upath)
+			setup_unix_listener(upath);
+		if (shmname)
+			m_shm = shmlink_create(shmname);
 		m_rxpos = m_txpos = m_ilen = 0;
 		m_started_flag = false;
 		m_uart_wait = 0; // Flow control into the FPGA
@@ -126,24 +271,21 @@ public:
 		// Close any active connection
 		if (m_con >= 0)	close(m_con);
 		if (m_skt >= 0) close(m_skt);
+		if (m_uskt >= 0) {
+			close(m_uskt);
+			unlink(m_upath);
+		} if (m_shm) {
+			munmap(m_shm, sizeof(SHMLINK));
+			shm_unlink(m_shmname);
+			m_shm = NULL;
+		}
 	}
 
 	virtual	void	tick(void) {
-		if (m_con < 0) {
-			// Can we accept a connection?
-			struct	pollfd	pb;
-
-			pb.fd = m_skt;
-			pb.events = POLLIN;
-			poll(&pb, 1, 0);
-
-			if (pb.revents & POLLIN) {
-				m_con = accept(m_skt, 0, 0);
-
-				if (m_con < 0)
-					perror("Accept failed:");
-			}
-		}
+		// Can we accept a connection?
+		try_accept(m_skt);
+		try_accept(m_uskt);
+		check_shm();
 
 		TESTB<VA>::m_core->i_rx_stb = 0;
 
@@ -153,6 +295,15 @@ public:
 				TESTB<VA>::m_core->i_rx_stb = 1;
 				TESTB<VA>::m_core->i_rx_data = m_rxbuf[m_rxpos++];
 				m_ilen--;
+			} else if (m_shm_con) {
+				m_ilen = m_shm->m_tofpga.read(m_rxbuf,
+						sizeof(m_rxbuf));
+				if (m_ilen > 0) {
+					TESTB<VA>::m_core->i_rx_stb = 1;
+					TESTB<VA>::m_core->i_rx_data = m_rxbuf[0];
+					m_rxpos = 1; m_ilen--;
+					m_started_flag = true;
+				}
 			} else if (m_con > 0) {
 				// Is there a byte to be read here?
 				struct	pollfd	pb;
@@ -203,12 +354,15 @@ public:
 
 		bool tx_accepted = false;
 		if (m_tx_busy == 0) {
-			if ((TESTB<VA>::m_core->o_tx_stb)&&(m_con > 0)) {
+			if ((TESTB<VA>::m_core->o_tx_stb)&&(connected())) {
 				m_txbuf[m_txpos++] = TESTB<VA>::m_core->o_tx_data;
 				tx_accepted = true;
 				if ((TESTB<VA>::m_core->o_tx_data == '\n')||(m_txpos >= (int)sizeof(m_txbuf))) {
 					int	snt = 0;
-					snt = send(m_con, m_txbuf, m_txpos, 0);
+					if (m_shm_con)
+						snt = shm_send();
+					else
+						snt = send(m_con, m_txbuf, m_txpos, 0);
 					if (snt < 0) {
 						close(m_con);
 						m_con = -1;
@@ -12,7 +12,8 @@
 //	Four registers control this DMA controller: a control/status register,
 //	a length register, a source WB address and a destination WB address.
 //	These register may be read at any time, but they may only be written
-//	to when the controller is idle.
+//	to when the controller is idle.  A fifth register, at local address
+//	four, holds a CRC of everything the controller reads.
 //
 //	The meanings of three of the setup registers should be self explanatory:
 //		- The length register controls the total number of words to
@@ -60,6 +61,17 @@
 //	remaining, or 32'hafed00 to abort the current transaction leaving
 //	any unfinished read/write in an undetermined state.
 //
+//	The CRC register, at local address four, is updated with every word
+//	the controller reads.  It is the (reflected) CRC-32 used by ethernet
+//	and zlib, taking the bytes of each word from the most significant
+//	byte down, but without the final inversion.  Writing to this register
+//	while the controller is idle sets the CRC to the value written, and
+//	places the controller into a CRC-only mode for its next transfer.  In
+//	this mode, the controller reads cfg_len words from the source address
+//	but never writes anything, allowing a memory's contents to be checked
+//	without moving them anywhere.  Seed the CRC with 32'hffffffff, and
+//	invert the result when done, to get the usual CRC-32.
+//
 //
 //	To use this, follow this checklist:
 //	1. Wait for any prior DMA operation to complete
@@ -131,7 +143,7 @@ module wbdmac(i_clk, i_reset,
 	input	wire		i_clk, i_reset;
 	// Slave/control wishbone inputs
 	input	wire		i_swb_cyc, i_swb_stb, i_swb_we;
-	input	wire	[1:0]	i_swb_addr;
+	input	wire	[2:0]	i_swb_addr;
 	input	wire [(DW-1):0]	i_swb_data;
 	// Slave/control wishbone outputs
 	output	reg		o_swb_ack;
@@ -159,12 +171,12 @@ module wbdmac(i_clk, i_reset,
 	//
 
 	wire	s_cyc, s_stb, s_we;
-	wire	[1:0]	s_addr;
+	wire	[2:0]	s_addr;
 	wire	[31:0]	s_data;
 `define	DELAY_ACCESS
 `ifdef	DELAY_ACCESS
 	reg	r_s_cyc, r_s_stb, r_s_we;
-	reg	[1:0]	r_s_addr;
+	reg	[2:0]	r_s_addr;
 	reg	[31:0]	r_s_data;
 
 	always @(posedge i_clk)
@@ -198,7 +210,8 @@ module wbdmac(i_clk, i_reset,
 	reg			cfg_err, cfg_len_nonzero;
 	reg	[(AW-1):0]	cfg_waddr, cfg_raddr, cfg_len;
 	reg [(LGMEMLEN-1):0]	cfg_blocklen_sub_one;
-	reg			cfg_incs, cfg_incd;
+	reg			cfg_incs, cfg_incd, cfg_crconly;
+	reg	[31:0]		r_crc;
 	reg	[(LGDV-1):0]	cfg_dev_trigger;
 	reg			cfg_on_dev_trigger;
 
@@ -209,6 +222,8 @@ module wbdmac(i_clk, i_reset,
 	reg	[(LGMEMLEN):0]	nread, nwritten, nwacks, nracks;
 	wire	[(AW-1):0]	bus_nracks;
 	assign	bus_nracks = { {(AW-LGMEMLEN-1){1'b0}}, nracks };
+	wire	[(AW-1):0]	bus_nread;
+	assign	bus_nread = { {(AW-LGMEMLEN-1){1'b0}}, nread };
 
 	reg	last_read_request, last_read_ack,
 		last_write_request, last_write_ack;
@@ -235,7 +250,7 @@ module wbdmac(i_clk, i_reset,
 		if ((s_stb)&&(s_we))
 		begin
 			case(s_addr)
-			2'b00: begin
+			3'b000: begin
 				if ((s_data[27:16] == 12'hfed)
 					&&(s_data[31:30] == 2'b00)
 						&&(cfg_len_nonzero))
@@ -249,9 +264,10 @@ module wbdmac(i_clk, i_reset,
 				cfg_incs  <= !s_data[29];
 				cfg_incd  <= !s_data[28];
 				end
-			2'b01: begin end // This is done elsewhere
-			2'b10: cfg_raddr <=  s_data[(AW+2-1):2];
-			2'b11: cfg_waddr <=  s_data[(AW+2-1):2];
+			3'b001: begin end // This is done elsewhere
+			3'b010: cfg_raddr <=  s_data[(AW+2-1):2];
+			3'b011: cfg_waddr <=  s_data[(AW+2-1):2];
+			default: begin end // The CRC is also set elsewhere
 			endcase
 		end end
 	`DMA_WAIT: begin
@@ -303,7 +319,13 @@ module wbdmac(i_clk, i_reset,
 	`DMA_PRE_WRITE: begin
 		o_mwb_addr <= cfg_waddr;
 		dma_state <= (abort)?`DMA_IDLE:`DMA_WRITE_REQ;
-		end
+		// In CRC-only mode, there's nothing to write.  Go on to the
+		// next block, if there is one.
+		if ((cfg_crconly)&&(!abort))
+		begin
+			o_mwb_addr <= cfg_raddr;
+			dma_state <= (cfg_len > bus_nread)?`DMA_WAIT:`DMA_IDLE;
+		end end
 	`DMA_WRITE_REQ: begin
 		if (!i_mwb_stall)
 		begin
@@ -347,6 +369,8 @@ module wbdmac(i_clk, i_reset,
 		o_interrupt <= ((dma_state == `DMA_WRITE_ACK)&&(i_mwb_ack)
 					&&(last_write_ack)
 					&&(cfg_len == {{(AW-1){1'b0}},1'b1}))
+				||((dma_state == `DMA_PRE_WRITE)&&(cfg_crconly)
+					&&(cfg_len <= bus_nread))
 				||((dma_state != `DMA_IDLE)&&(i_mwb_err));
 
 
@@ -358,7 +382,7 @@ module wbdmac(i_clk, i_reset,
 		cfg_len <= 0;
 		cfg_len_nonzero <= 1'b0;
 	end else if ((dma_state == `DMA_IDLE)
-			&&(s_stb)&&(s_we)&&(s_addr == 2'b01))
+			&&(s_stb)&&(s_we)&&(s_addr == 3'b001))
 	begin
 		cfg_len   <=  s_data[(AW-1):0];
 		cfg_len_nonzero <= (|s_data[(AW-1):0]);
@@ -366,6 +390,12 @@ module wbdmac(i_clk, i_reset,
 	begin
 		cfg_len <= cfg_len - 1'b1;
 		cfg_len_nonzero <= (cfg_len > 1);
+	end else if ((cfg_crconly)&&(dma_state == `DMA_PRE_WRITE))
+	begin
+		// Without any writes to count down, count the whole block
+		// that was just read at once
+		cfg_len <= cfg_len - bus_nread;
+		cfg_len_nonzero <= (cfg_len > bus_nread);
 	end
 
 	initial	nracks   = 0;
@@ -410,7 +440,7 @@ module wbdmac(i_clk, i_reset,
 		cfg_err <= 1'b0;
 	else if (dma_state == `DMA_IDLE)
 	begin
-		if ((s_stb)&&(s_we)&&(s_addr==2'b00))
+		if ((s_stb)&&(s_we)&&(s_addr==3'b000))
 			cfg_err <= 1'b0;
 	end else if (((i_mwb_err)&&(o_mwb_cyc))||(abort))
 		cfg_err <= 1'b1;
@@ -437,6 +467,54 @@ module wbdmac(i_clk, i_reset,
 	wire	[(LGMEMLEN):0]	next_nread;
 	assign	next_nread = nread + 1'b1;
 
+	// CRC-only mode lasts for one transfer.  It's cleared once that
+	// transfer completes, so the next one will need to ask again.
+	reg	r_busy;
+	initial	r_busy = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		r_busy <= 1'b0;
+	else
+		r_busy <= (dma_state != `DMA_IDLE);
+
+	initial	cfg_crconly = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		cfg_crconly <= 1'b0;
+	else if ((dma_state == `DMA_IDLE)&&(s_stb)&&(s_we)
+			&&(s_addr == 3'b100))
+		cfg_crconly <= 1'b1;
+	else if ((r_busy)&&(dma_state == `DMA_IDLE))
+		cfg_crconly <= 1'b0;
+
+	//
+	// crc32w
+	//
+	// Update a (reflected) CRC-32 with one more word, most significant
+	// byte first
+	function [31:0] crc32w;
+		input	[31:0]	crc, data;
+		integer		k;
+		reg	[31:0]	c;
+	begin
+		c = crc;
+		for(k=0; k<32; k=k+1)
+			c = { 1'b0, c[31:1] } ^ (((c[0])
+				^ data[8*(3-(k/8))+(k%8)]) ? 32'hedb88320 : 0);
+		crc32w = c;
+	end endfunction
+
+	initial	r_crc = 32'hffffffff;
+	always @(posedge i_clk)
+	if (i_reset)
+		r_crc <= 32'hffffffff;
+	else if ((dma_state == `DMA_IDLE)&&(s_stb)&&(s_we)
+			&&(s_addr == 3'b100))
+		r_crc <= s_data;
+	else if (((dma_state == `DMA_READ_REQ)||(dma_state == `DMA_READ_ACK))
+			&&(i_mwb_ack)&&(!i_mwb_err))
+		r_crc <= crc32w(r_crc, i_mwb_data);
+
 	initial	last_read_ack = 1'b0;
 	always @(posedge i_clk)
 	if (i_reset)
@@ -530,15 +608,16 @@ module wbdmac(i_clk, i_reset,
 	if (i_reset)
 		o_swb_data <= 0;
 	else casez(s_addr)
-		2'b00: o_swb_data <= {	(dma_state != `DMA_IDLE), cfg_err,
+		3'b000: o_swb_data <= {	(dma_state != `DMA_IDLE), cfg_err,
 					!cfg_incs, !cfg_incd,
 					1'b0, nread,
 					cfg_on_dev_trigger, cfg_dev_trigger,
 					cfg_blocklen_sub_one
 					};
-		2'b01: o_swb_data <= { {(DW-AW){1'b0}}, cfg_len  };
-		2'b10: o_swb_data <= { {(DW-2-AW){1'b0}}, cfg_raddr, 2'b00 };
-		2'b11: o_swb_data <= { {(DW-2-AW){1'b0}}, cfg_waddr, 2'b00 };
+		3'b001: o_swb_data <= { {(DW-AW){1'b0}}, cfg_len  };
+		3'b010: o_swb_data <= { {(DW-2-AW){1'b0}}, cfg_raddr, 2'b00 };
+		3'b011: o_swb_data <= { {(DW-2-AW){1'b0}}, cfg_waddr, 2'b00 };
+		default: o_swb_data <= r_crc;
 	endcase
 
 	// This causes us to wait a minimum of two clocks before starting: One
@@ -575,14 +654,14 @@ module wbdmac(i_clk, i_reset,
 		abort <= 1'b0;
 	else
 		abort <= ((s_stb)&&(s_we)
-			&&(s_addr == 2'b00)
+			&&(s_addr == 3'b000)
 			&&(s_data == 32'hffed0000));
 
 	initial	user_halt = 1'b0;
 	always @(posedge i_clk)
 		user_halt <= ((user_halt)&&(dma_state != `DMA_IDLE))
 			||((s_stb)&&(s_we)&&(dma_state != `DMA_IDLE)
-				&&(s_addr == 2'b00)
+				&&(s_addr == 3'b000)
 				&&(s_data == 32'hafed0000));
 
 
@@ -139,9 +139,9 @@
 `define	MMU_ADDR	8'h80
 `endif
 
-// Although I have a hole at 5'h2, the DMA controller requires four wishbone
-// addresses, therefore we place it by itself and expand our address bus
-// width here by another bit.
+// Although I have a hole at 5'h2, the DMA controller requires five wishbone
+// addresses (four, plus its CRC), therefore we place it by itself and expand
+// our address bus width here by another bit.
 `define	DMAC		5'h10
 
 // `define	RTC_CLOCK	32'hc0000008	// A global something
@@ -583,7 +583,7 @@ module	zipsystem(i_clk, i_reset,
 `ifdef	INCLUDE_DMA_CONTROLLER
 	wbdmac	#(PAW) dma_controller(i_clk, cpu_reset,
 				sys_cyc, dmac_stb, sys_we,
-					sys_addr[1:0], sys_data,
+					sys_addr[2:0], sys_data,
 					dmac_ack, dmac_stall, dmac_data,
 				// Need the outgoing DMAC wishbone bus
 				dc_cyc, dc_stb, dc_we, dc_addr, dc_data,
@@ -20,6 +20,23 @@
 //	by issuing a new address--hence the table is reset for every new piece
 //	of software that may wish to communicate.
 //
+//	The original codewords can only reach 521 words into the past.  Once
+//	the host asks for it (option 2, see wbuexec.v), a long history mode
+//	is enabled where matches further back than that are sent as three
+//	character codewords, {4'b1100, idx[12], inc, idx[11:0]}, referencing
+//	the word idx+522 back.  Such words are then added to the table again,
+//	just as a raw word would be.  This allows the whole table to be used,
+//	with TBITS from 10 up to 13.  Option 1, or a bus reset, returns to
+//	the original mode.
+//
+//	Option 3 enables delta codewords as well.  Words that aren't in the
+//	table, but are close to the last word sent, are sent as the difference
+//	from it, {5'h1b, inc, 1'b0, d[4:0]} for small signed differences, or
+//	{5'h1b, inc, 2'b10, d[15:0]} for larger ones, or else as the exclusive
+//	or with it, {5'h1b, inc, 2'b11, x[15:0]}.  The last word is taken to
+//	be zero following every address.  Delta coded words are added to the
+//	table, as raw words are.
+//
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -53,7 +70,7 @@
 // All input words are valid codewords.  If we can, we make them
 // better here.
 module	wbucompress(i_clk, i_stb, i_codword, o_stb, o_cword, i_busy);
-	parameter	DW=32, CW=36, TBITS=10;
+	parameter	DW=32, CW=36, TBITS=12;
 	input	wire			i_clk, i_stb;
 	input	wire	[(CW-1):0]	i_codword;
 	output	wire			o_stb;
@@ -103,6 +120,34 @@ module	wbucompress(i_clk, i_stb, i_codword, o_stb, o_cword, i_busy);
 		else if (~i_busy)
 			a_stb <= 1'b0;
 
+	//
+	// Are we allowed to use the long history codewords?  The host must
+	// ask for them, since older host software doesn't understand them.
+	// We find out by watching the options the host sends us go by.
+	//
+	reg		r_lghist, r_delta;
+	initial	r_lghist = 1'b0;
+	initial	r_delta  = 1'b0;
+	always @(posedge i_clk)
+		if ((i_stb)&&(~a_stb))
+		begin
+			if (i_codword[35:30] == 6'h3) // Bus reset
+			begin
+				r_lghist <= 1'b0;
+				r_delta  <= 1'b0;
+			end else if (i_codword[35:30] == 6'h34) // Option
+			begin
+				if (i_codword[5:0] == 6'h1)
+				begin
+					r_lghist <= 1'b0;
+					r_delta  <= 1'b0;
+				end else if (i_codword[5:0] == 6'h2)
+					r_lghist <= 1'b1;
+				else if (i_codword[5:0] == 6'h3)
+					r_delta  <= 1'b1;
+			end
+		end
+
 
 	//
 	//
@@ -151,14 +196,19 @@ module	wbucompress(i_clk, i_stb, i_codword, o_stb, o_cword, i_busy);
 			// Otherwise, on any valid return result that wasn't
 			// from our table, for whatever reason (such as didn't
 			// have the clocks to find it, etc.), increment the
-			// address to add another value into our table
-			else if (o_cword[35:33] == 3'b111)
+			// address to add another value into our table.  Long
+			// history references are added again as well, so that
+			// the next reference to the same word will be short,
+			// as are delta coded words.
+			else if ((o_cword[35:33] == 3'b111)
+					||(o_cword[35:32] == 4'hc)
+					||(o_cword[35:31] == 5'h1b))
 				tbl_addr <= tbl_addr + {{(TBITS-1){1'b0}},1'b1};
 		end
 	always @(posedge i_clk)
 		if ((w_accepted)&&(o_cword[35:33]==3'h1)) // on new address
 			tbl_filled <= 1'b0;
-		else if (tbl_addr == 10'h3ff)
+		else if (&tbl_addr)
 			tbl_filled <= 1'b1;
 
 	// Now that we know where we are writing into the table, and what
@@ -243,37 +293,91 @@ module	wbucompress(i_clk, i_stb, i_codword, o_stb, o_cword, i_busy);
 					&&(pmatch == 2'b11);
 		end
 
-	reg	zmatch, hmatch, fmatch;
+	reg	zmatch, hmatch, fmatch, xmatch;
 	always @(posedge i_clk)
 		if (~match)
 		begin
 			matchaddr <= maddr;
-			fmatch    <= (maddr < 10'h521);
-			zmatch    <= (maddr == 10'h1);
-			hmatch    <= (maddr < 10'd10);
+			xmatch    <= (maddr >= 522);
+			fmatch    <= (maddr < 522)||(r_lghist);
+			zmatch    <= (maddr == 1);
+			hmatch    <= (maddr < 10);
 		end
 
+	//
+	// While we look, we can also see how close this word is to the last
+	// one we sent.  r_prev is the last data word sent, or zero following
+	// an address.  The differences are registered, and only used once
+	// pmatch shows both words have been stable long enough for them to
+	// be valid.
+	//
+	reg	[(DW-1):0]	r_prev, d_diff, d_xor;
+	reg			d_small, d_short, x_short;
+	initial	r_prev = 0;
+	always @(posedge i_clk)
+		if (w_accepted)
+		begin
+			if (o_cword[35:33]==3'h1) // New address
+				r_prev <= 0;
+			else if (r_word[35:33] == 3'b111) // Any data word
+				r_prev <= { r_word[32:31], r_word[29:0] };
+		end
+
+	always @(posedge i_clk)
+	begin
+		d_diff <= { r_word[32:31], r_word[29:0] } - r_prev;
+		d_xor  <= { r_word[32:31], r_word[29:0] } ^ r_prev;
+
+		d_small <= (d_diff[(DW-1):4] == 0)||(&d_diff[(DW-1):4]);
+		d_short <= (d_diff[(DW-1):15] == 0)||(&d_diff[(DW-1):15]);
+		x_short <= (d_xor[(DW-1):16] == 0);
+	end
+
+	wire	w_delta;
+	assign	w_delta = (r_delta)&&(r_word[35:33]==3'b111)&&(pmatch == 2'b11);
+
 	// Did we find something?
 	wire	[9:0]		adr_dbld;
 	wire	[2:0]		adr_hlfd;
+	wire	[13:0]		adr_xtnd;
 	assign	adr_hlfd = matchaddr[2:0]- 3'd2;
-	assign	adr_dbld = matchaddr- 10'd10;
+	assign	adr_dbld = matchaddr[9:0]- 10'd10;
+	assign	adr_xtnd = { {(14-TBITS){1'b0}}, matchaddr } - 14'd522;
 	reg	[(CW-1):0]	r_cword; // Record our result
 	always @(posedge i_clk)
 	begin
 		if ((~a_stb)||(~r_stb)||(w_accepted))//Reset whenever word gets written
 		begin
 			r_cword <= r_word;
-		end else if ((match)&&(fmatch)) // &&(r_word == a_addrword))
+		end else if ((match)&&(fmatch)&&(~xmatch))
 		begin
 			r_cword <= r_word;
 			if (zmatch) // matchaddr == 1
 				r_cword[35:30] <= { 5'h3, r_word[30] };
 			else if (hmatch) // 2 <= matchaddr <= 9
 				r_cword[35:30] <= { 2'b10, adr_hlfd, r_word[30] };
-			else // if (adr_diff < 10'd521)
+			else // if (adr_diff < 10'd522)
 				r_cword[35:24] <= { 2'b01, adr_dbld[8:6],
 						r_word[30], adr_dbld[5:0] };
+		end else if ((w_delta)&&(d_small)) // Two character delta
+		begin
+			r_cword <= r_word;
+			r_cword[35:24] <= { 5'h1b, r_word[30], 1'b0, d_diff[4:0] };
+		end else if ((match)&&(fmatch)) // matchaddr >= 522
+		begin
+			r_cword <= r_word;
+			r_cword[35:18] <= { 4'b1100, adr_xtnd[12],
+					r_word[30], adr_xtnd[11:0] };
+		end else if ((w_delta)&&(d_short)) // Four character delta
+		begin
+			r_cword <= r_word;
+			r_cword[35:12] <= { 5'h1b, r_word[30], 2'b10,
+					d_diff[15:0] };
+		end else if ((w_delta)&&(x_short)) // Four character xor
+		begin
+			r_cword <= r_word;
+			r_cword[35:12] <= { 5'h1b, r_word[30], 2'b11,
+					d_xor[15:0] };
 		end else
 			r_cword <= r_word;
 	end
@@ -284,8 +388,8 @@ module	wbucompress(i_clk, i_stb, i_codword, o_stb, o_cword, i_busy);
 
 	// Make verilator happy
 	// verilator lint_off UNUSED
-	wire	unused;
-	assign	unused = adr_dbld[9];
+	wire	[1:0]	unused;
+	assign	unused = { adr_dbld[9], adr_xtnd[13] };
 	// verilator lint_on  UNUSED
 endmodule
 
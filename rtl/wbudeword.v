@@ -55,6 +55,10 @@ module	wbudeword(i_clk, i_stb, i_word, i_tx_busy, o_stb, o_nl_hexbits, o_busy);
 			: (i_word[35:32]==4'h3)? (3'b010+{1'b0,i_word[31:30]})
 			: (i_word[35:34]==2'b01)? 3'b010
 			: (i_word[35:34]==2'b10)? 3'b001
+			: (i_word[35:32]==4'hc)? 3'b011	// Long history ref
+			: (i_word[35:31]==5'h1a)? 3'b001 // Option reply
+			: (i_word[35:31]==5'h1b)? ((i_word[29])? 3'b100:3'b010)
+							// Delta
 			:  3'b110;
 
 	reg		r_dly;
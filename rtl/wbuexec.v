@@ -10,6 +10,27 @@
 //	codewords that are sent out.  Compression and/or decompression, coding
 //	etc. all take place external to this routine.
 //
+//	A fill codeword, 4'b0001 in the top bits, repeats the last value
+//	written for the number of words given in its bottom 24 bits,
+//	incrementing the address if bit 30 is set.  Only one acknowledgement
+//	is returned, once every write has been issued.  A fill of zero words
+//	writes nothing, but is still acknowledged.
+//
+//	An empty fill with a non-zero value in bits 29:24 is instead an
+//	option.  It is answered with a 6'h34 codeword carrying the option
+//	number, which is how the host learns that options are understood.
+//	The options themselves are acted upon by wbucompress.v:
+//
+//	1. Returns to the original compression: the original history, and
+//		no delta codewords.
+//	2. Selects the long compression history.
+//	3. Enables delta codewords, which send a word as its difference
+//		from, or exclusive or with, the last word sent.
+//
+//	Options 2 and 3 may both be given, and a bus reset, like option 1,
+//	clears both.  An FPGA that predates options will acknowledge these
+//	as it would any empty fill.
+//
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -46,6 +67,7 @@
 `define	WB_ACK			3'b011
 `define	WB_WAIT_ON_NEXT_WRITE	3'b100
 `define	WB_FLUSH_WRITE_REQUESTS	3'b101
+`define	WB_FILL			3'b110
 
 module	wbuexec(i_clk, i_rst, i_stb, i_codword, o_busy,
 		o_wb_cyc, o_wb_stb, o_wb_we, o_wb_addr, o_wb_data,
@@ -86,6 +108,8 @@ module	wbuexec(i_clk, i_rst, i_stb, i_codword, o_busy,
 	reg	[9:0]	r_acks_needed, r_len;
 	reg	r_inc, r_new_addr, last_read_request, last_ack, zero_acks;
 	reg	single_read_request;
+	reg	[31:0]	r_fill_data;
+	reg	[23:0]	r_fill_len;
 
 	initial	r_new_addr = 1'b1;
 	initial	wb_state = `WB_IDLE;
@@ -154,6 +178,25 @@ module	wbuexec(i_clk, i_rst, i_stb, i_codword, o_busy,
 					o_wb_cyc <= 1'b1;
 					o_wb_stb <= 1'b1;
 					end
+				4'b0001: begin // Repeat the last write
+					o_wb_data <= r_fill_data;
+					if (i_codword[29:24] != 6'h0)
+					begin
+						// An option, not a fill.  Pass
+						// it on to the output chain
+						o_stb <= 1'b1;
+						o_codword <= { 6'h34, 24'h0,
+							i_codword[29:24] };
+					end else if (i_codword[23:0] == 24'h0)
+					begin
+						// Nothing to write, just ack
+						o_stb <= 1'b1;
+						o_codword <= { 6'h2, i_wb_data[29:0] };
+					end else begin
+						wb_state <= `WB_FILL;
+						o_wb_cyc <= 1'b1;
+						o_wb_stb <= 1'b1;
+					end end
 				4'b11??: begin // Start a vector read
 					// Address is already set ...
 					// This also depends upon the decoder working
@@ -225,6 +268,32 @@ module	wbuexec(i_clk, i_rst, i_stb, i_codword, o_busy,
 				wb_state <= `WB_WAIT_ON_NEXT_WRITE;
 				o_wb_stb <= 1'b0;
 			end end
+		`WB_FILL: begin
+			o_wb_cyc <= 1'b1;
+			o_wb_stb <= 1'b1;
+
+			// Acknowledge the whole fill once, when the last write
+			// request is accepted.  Acknowledging every write would
+			// quickly overflow the return FIFO.
+			o_codword <= (i_wb_err) ? { 6'h5, i_wb_data[29:0] }
+						: { 6'h2, i_wb_data[29:0] };
+			o_stb <= (i_wb_err)
+				||((~i_wb_stall)&&(r_fill_len == 24'h1));
+
+			if ((r_inc)&&(~i_wb_stall))
+				o_wb_addr <= o_wb_addr + 32'h001;
+
+			if (i_wb_err)
+			begin
+				wb_state <= `WB_IDLE;
+				o_wb_cyc <= 1'b0;
+				o_wb_stb <= 1'b0;
+			end else if ((~i_wb_stall)&&(r_fill_len == 24'h1))
+			begin
+				// Wait for the remaining acks
+				wb_state <= `WB_ACK;
+				o_wb_stb <= 1'b0;
+			end end
 		`WB_ACK: begin
 			o_wb_cyc <= 1'b1;
 			o_wb_stb <= 1'b0;
@@ -336,6 +405,17 @@ module	wbuexec(i_clk, i_rst, i_stb, i_codword, o_busy,
 	always @(posedge i_clk)
 		zero_acks <= (~o_wb_stb)&&(r_acks_needed == 10'h00);
 
+	// The value to be repeated by a fill is the last one written
+	always @(posedge i_clk)
+		if (w_newwr)
+			r_fill_data <= w_cod_data;
+
+	always @(posedge i_clk)
+		if (!o_wb_cyc)
+			r_fill_len <= i_codword[23:0];
+		else if ((o_wb_stb)&&(~i_wb_stall))
+			r_fill_len <= r_fill_len - 24'h1;
+
 	always @(posedge i_clk)
 		if (!o_wb_stb) // (!o_wb_cyc)&&(i_codword[35:34] == 2'b11))
 			r_len <= i_codword[9:0];
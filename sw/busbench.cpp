@@ -0,0 +1,289 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	busbench.cpp
+//
+// Project:	XuLA2-LX25 SoC based upon the ZipCPU
+//
+// Purpose:	To measure how well the debugging bus is working.  This
+//		program times single word reads and writes, reporting a
+//	histogram of how long each took, and then measures the throughput of
+//	vector reads and writes from 1 to 4096 words long.  For every test,
+//	it also reports how many characters crossed the link in each direction
+//	per word, and hence how well the bus is compressing things.
+//
+//	This works against anything a DEVBUS can connect to: the USB-JTAG
+//	port (-u), or a network port (-p), be it netusb or the busmaster_tb
+//	simulation.  The latter allows regressions to be caught without any
+//	hardware.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015-2017, Gisselquist Technology, LLC
+//
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of  the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+//
+// License:	GPL, v3, as defined and found on www.gnu.org,
+//		http://www.gnu.org/licenses/gpl.html
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <strings.h>
+#include <ctype.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "llcomms.h"
+#include "usbi.h"
+#include "port.h"
+#include "regdefs.h"
+
+// Latency histogram buckets, by powers of two in microseconds.  The last
+// bucket holds everything longer.
+#define	NBUCKETS	16
+// The largest vector tested
+#define	MAXBENCHLEN	4096
+
+FPGA		*m_fpga;
+LLCOMMSI	*m_comms;
+
+void	closeup(int v) {
+	m_fpga->kill();
+	exit(0);
+}
+
+double	now(void) {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//
+// latency
+//
+// Time n single word operations, one at a time, and print out a histogram
+// of how long they took.
+void	latency(const char *name, const unsigned addr, const int n, bool wr) {
+	unsigned	hist[NBUCKETS];
+	double		total = 0.0, mn = 1e9, mx = 0.0;
+	unsigned long	nwrit, nread;
+
+	for(int k=0; k<NBUCKETS; k++)
+		hist[k] = 0;
+
+	nwrit = m_comms->m_total_nwrit;
+	nread = m_fpga->m_total_nread;
+	for(int i=0; i<n; i++) {
+		double		start, dt;
+		unsigned	us;
+		int		b;
+
+		start = now();
+		if (wr)
+			m_fpga->writeio(addr, i);
+		else
+			m_fpga->readio(addr);
+		dt = now() - start;
+
+		total += dt;
+		if (dt < mn) mn = dt;
+		if (dt > mx) mx = dt;
+
+		us = (unsigned)(dt * 1e6);
+		for(b=0; (b<NBUCKETS-1)&&(us >= (2u<<b)); b++)
+			;
+		hist[b]++;
+	}
+
+	printf("%s latency, %d samples: min %.1f us, mean %.1f us, max %.1f us\n",
+		name, n, mn*1e6, total/n*1e6, mx*1e6);
+	printf("\t%.2f chars/word out, %.2f chars/word in\n",
+		(m_comms->m_total_nwrit - nwrit)/(double)n,
+		(m_fpga->m_total_nread - nread)/(double)n);
+	for(int k=0; k<NBUCKETS; k++) {
+		int	bar;
+
+		if (hist[k] == 0)
+			continue;
+		if (k == NBUCKETS-1)
+			printf("\t  >= %6u us: %6u ", 1u<<k, hist[k]);
+		else
+			printf("\t< %6u us: %6u ", 2u<<k, hist[k]);
+		bar = (int)(50.0 * hist[k] / n + 0.5);
+		for(int j=0; j<bar; j++)
+			putchar('*');
+		putchar('\n');
+	}
+}
+
+//
+// throughput
+//
+// Run a vector operation, len words at a time, over and over until either
+// mintime has passed or at least minwords words have been moved, and then
+// report how fast it went.
+void	throughput(const char *name, const unsigned addr, const int len,
+		FPGA::BUSW *buf, const int op, const double mintime,
+		const long minwords) {
+	unsigned long	nwrit, nread;
+	long		nw = 0;
+	double		start, dt;
+
+	nwrit = m_comms->m_total_nwrit;
+	nread = m_fpga->m_total_nread;
+	start = now();
+	do {
+		switch(op) {
+		case 0: m_fpga->readi(addr, len, buf); break;
+		case 1: m_fpga->readz(addr, len, buf); break;
+		default: m_fpga->writei(addr, len, buf); break;
+		}
+		nw += len;
+		dt = now() - start;
+	} while((dt < mintime)||(nw < minwords));
+
+	if (op >= 2) {
+		// The last writes may not have been acknowledged yet.  Reading
+		// something back waits for them, so they're counted as well.
+		m_fpga->readio(R_VERSION);
+		dt = now() - start;
+	}
+
+	nwrit = m_comms->m_total_nwrit - nwrit;
+	nread = m_fpga->m_total_nread - nread;
+	printf("%-6s %5d %10.0f %8.3f %9.1f %8.2f %8.2f %7.2f\n",
+		name, len, nw/dt, nw*4.0/dt/1e6, dt/(nw/len)*1e6,
+		nwrit/(double)nw, nread/(double)nw,
+		// Compression: bytes of data moved, per byte across the link
+		// in the direction the data went
+		(nw*4.0)/(double)((op < 2) ? nread : nwrit));
+}
+
+void	usage(void) {
+	printf("USAGE: busbench [-u] [-p[port]] [-a address] [-n samples] [-c] [-r]\n"
+"\n"
+"\tMeasures the latency and throughput of the debugging bus.\n"
+"\n"
+"\t-u\tConnect via the USB-JTAG port (the default)\n"
+"\t-p\tConnect via a network port, such as that of netusb, or of the\n"
+"\t\tbusmaster_tb simulation.  The port number may follow, as in\n"
+"\t\t-p%d\n"
+"\t-a\tThe address of at least %d words of memory that may be\n"
+"\t\tread and written.  This defaults to the SDRAM.\n"
+"\t-n\tThe number of single word operations to time.\n"
+"\t-c\tWrite compressible data, rather than random data\n"
+"\t-r\tRead only.  Don't write to the memory at all.\n",
+		FPGAPORT, MAXBENCHLEN);
+}
+
+int main(int argc, char **argv) {
+	int		skp=0, port = FPGAPORT, nsamples = 1000;
+	bool		use_usb = true, compressible = false, read_only = false;
+	unsigned	addr = SDRAMBASE;
+	FPGA::BUSW	*buf;
+
+	skp=1;
+	for(int argn=0; argn<argc-skp; argn++) {
+		if (argv[argn+skp][0] == '-') {
+			if (argv[argn+skp][1] == 'u')
+				use_usb = true;
+			else if (argv[argn+skp][1] == 'p') {
+				use_usb = false;
+				if (isdigit(argv[argn+skp][2]))
+					port = atoi(&argv[argn+skp][2]);
+			} else if ((argv[argn+skp][1] == 'a')
+					||(argv[argn+skp][1] == 'n')) {
+				if (argn+skp+1 >= argc) {
+					usage();
+					exit(EXIT_FAILURE);
+				}
+				if (argv[argn+skp][1] == 'a')
+					addr = strtoul(argv[argn+skp+1], NULL, 0);
+				else
+					nsamples = atoi(argv[argn+skp+1]);
+				skp++; argn--;
+			} else if (argv[argn+skp][1] == 'c')
+				compressible = true;
+			else if (argv[argn+skp][1] == 'r')
+				read_only = true;
+			else {
+				usage();
+				exit(EXIT_SUCCESS);
+			}
+			skp++; argn--;
+		} else
+			argv[argn] = argv[argn+skp];
+	} argc -= skp;
+
+	if ((argc != 0)||(nsamples <= 0)||(addr & 3)) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if (use_usb)
+		m_comms = new USBI();
+	else
+		m_comms = new NETCOMMS(FPGAHOST, port);
+	m_fpga = new FPGA(m_comms);
+
+	signal(SIGSTOP, closeup);
+	signal(SIGHUP, closeup);
+
+	buf = new FPGA::BUSW[MAXBENCHLEN];
+	srand(0);
+	for(int i=0; i<MAXBENCHLEN; i++)
+		buf[i] = (compressible) ? (i & 0x0f) : rand();
+
+	try {
+		printf("VERSION: %08x\n", m_fpga->readio(R_VERSION));
+
+		latency("readio", addr, nsamples, false);
+		if (!read_only)
+			latency("writeio", addr, nsamples, true);
+
+		printf("\n%-6s %5s %10s %8s %9s %8s %8s %7s\n",
+			"OP", "LEN", "Words/s", "MB/s", "us/call",
+			"Out/wd", "In/wd", "Ratio");
+		for(int len=1; len<=MAXBENCHLEN; len<<=1) {
+			if (!read_only)
+				throughput("writei", addr, len, buf, 2, 0.25, 4096);
+			throughput("readi",  addr, len, buf, 0, 0.25, 4096);
+			throughput("readz",  addr, len, buf, 1, 0.25, 4096);
+		}
+	} catch(BUSERR b) {
+		fprintf(stderr, "BUS ERROR at address 0x%08x\n", b.addr);
+		delete	m_fpga;
+		exit(EXIT_FAILURE);
+	}
+
+	printf("\nTotal: %ld characters written, %ld read\n",
+		m_comms->m_total_nwrit, m_fpga->m_total_nread);
+	m_fpga->print_stats(stdout);
+
+	delete[] buf;
+	delete	m_fpga;
+}
@@ -60,6 +60,17 @@ public:
 	BUSERR(const uint32 a) : addr(a) {};
 };
 
+// One operation within a vectored bus transaction, see DEVBUS::transact
+class	BUSOP {
+public:
+	bool	wr;	// True for a write, false for a read
+	uint32	addr;	// The address to be read or written
+	uint32	data;	// The value to write, or the value once read
+	BUSOP(void) : wr(false), addr(0), data(0) {};
+	BUSOP(const bool w, const uint32 a, const uint32 d = 0)
+		: wr(w), addr(a), data(d) {};
+};
+
 class	DEVBUS {
 public:
 	typedef	uint32	BUSW;
@@ -120,6 +131,90 @@ public:
 	//
 	virtual	void	writez(const BUSW a, const int len, const BUSW *buf) = 0;
 
+	// Issue a series of reads and writes to arbitrary addresses, in order
+	//	ops is an array of n operations.  For every write, ops[i].data
+	//		holds the value to be written.  For every read, the
+	//		value read is returned in ops[i].data.
+	// This is equivalent to:
+	//	for(int i=0; i<n; i++)
+	//		if (ops[i].wr)
+	//			writeio(ops[i].addr, ops[i].data);
+	//		else
+	//			ops[i].data = readio(ops[i].addr);
+	// only an implementation may send them all at once, rather than
+	// waiting on each in turn.
+	virtual	void	transact(BUSOP *ops, const int n) {
+		for(int i=0; i<n; i++) {
+			if (ops[i].wr)
+				writeio(ops[i].addr, ops[i].data);
+			else
+				ops[i].data = readio(ops[i].addr);
+		}
+	}
+
+	// Write the same value to a block of memory
+	//	a is the address of the first word to be written
+	//	len is the number of words to write
+	//	v is the value to write to every one of them
+	// This is equivalent to:
+	//	for(int i=0; i<len; i++)
+	//		writeio(a+(i<<2), v);
+	// only an implementation may be able to do this without sending every
+	// word across the link.
+	virtual	void	fill(const BUSW a, const int len, const BUSW v) {
+		BUSW	buf[256];
+
+		for(int i=0; i<256; i++)
+			buf[i] = v;
+		for(int nw=0; nw<len; nw+=256)
+			writei(a+(nw<<2), (len-nw>256)?256:len-nw, buf);
+	}
+
+	// Write a repeating pattern to a block of memory, so that
+	//	for(int i=0; i<len; i++)
+	//		writeio(a+(i<<2), pat[i%plen]);
+	virtual	void	fill_pattern(const BUSW a, const int len,
+			const BUSW *pat, const int plen) {
+		BUSW	buf[256];
+
+		if (plen <= 0)
+			return;
+		for(int nw=0; nw<len; nw+=256) {
+			int	ln = (len-nw>256)?256:len-nw;
+			for(int i=0; i<ln; i++)
+				buf[i] = pat[(nw+i)%plen];
+			writei(a+(nw<<2), ln, buf);
+		}
+	}
+
+	// Start a read without waiting for it to complete
+	//	a, len, and buf are as for readi (or readz) above.  buf must
+	//		remain valid until the read has completed.
+	//	The return value is a handle which may then be passed to
+	//	poll_read(), to ask whether or not the read has completed, or to
+	//	wait_read(), to block until it has.  Reads complete in the order
+	//	they were submitted.  Any other bus call will first wait for
+	//	all outstanding reads to complete.
+	// This allows a program to process one block of data while the next
+	// is being read.  By default, the read takes place right here and the
+	// handle is always complete.
+	virtual	int	submit_readi(const BUSW a, const int len, BUSW *buf) {
+		readi(a, len, buf);
+		return 0;
+	}
+	virtual	int	submit_readz(const BUSW a, const int len, BUSW *buf) {
+		readz(a, len, buf);
+		return 0;
+	}
+
+	// Returns true once the read identified by handle h has completed,
+	// without blocking
+	virtual	bool	poll_read(const int h) { return true; }
+
+	// Block until the read identified by handle h has completed.  Any bus
+	// error encountered while reading will be thrown from here.
+	virtual	void	wait_read(const int h) { }
+
 	// Query whether or not an interrupt has taken place
 	virtual	bool	poll(void) = 0;
 
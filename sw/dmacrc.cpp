@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	dmacrc.cpp
+//
+// Project:	XuLA2-LX25 SoC based upon the ZipCPU
+//
+// Purpose:	To have the ZipSystem's DMA controller calculate the CRC of a
+//		block of memory on the board, and to calculate the same CRC
+//	here, for comparison.  See dmacrc.h.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015-2017, Gisselquist Technology, LLC
+//
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of  the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+//
+// License:	GPL, v3, as defined and found on www.gnu.org,
+//		http://www.gnu.org/licenses/gpl.html
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#include <stdio.h>
+#include <stdint.h>
+
+#include "regdefs.h"
+#include "dmacrc.h"
+
+// A value to write to the CRC register, to see if it's there.  On a DMA
+// controller without a CRC, this lands in the control register instead,
+// where it won't start anything, and where it won't read back the same.
+#define	CRCPROBE	0xffffffff
+
+uint32_t crc32w(const int len, const uint32_t *buf, const uint32_t prior) {
+	static	uint32_t	tbl[256];
+	static	bool		tbl_built = false;
+	uint32_t	crc = ~prior;
+
+	if (!tbl_built) {
+		for(unsigned i=0; i<256; i++) {
+			uint32_t	c = i;
+			for(int k=0; k<8; k++)
+				c = (c>>1) ^ ((c&1) ? 0xedb88320 : 0);
+			tbl[i] = c;
+		} tbl_built = true;
+	}
+
+	for(int i=0; i<len; i++) {
+		for(int b=24; b>=0; b-=8)
+			crc = tbl[(crc ^ (buf[i]>>b)) & 0x0ff] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
+
+bool	DMACRC::supported(void) {
+	if (m_cap == 0) {
+		BUSOP	ops[4];
+
+		ops[0] = BUSOP(true,  R_ZIPCTRL, CPU_DMACRC);
+		ops[1] = BUSOP(true,  R_ZIPDATA, CRCPROBE);
+		ops[2] = BUSOP(true,  R_ZIPCTRL, CPU_DMACRC);
+		ops[3] = BUSOP(false, R_ZIPDATA);
+		try {
+			m_fpga->transact(ops, 4);
+			m_cap = (ops[3].data == CRCPROBE) ? 1 : -1;
+		} catch(BUSERR b) {
+			m_cap = -1;
+		}
+
+		if (m_cap < 0)
+			printf("This board can\'t calculate CRCs, reading back instead\n");
+	}
+
+	return (m_cap > 0);
+}
+
+bool	DMACRC::crc(const uint32 a, const int len, uint32_t &crc) {
+	uint32	ctrl;
+	bool	r;
+
+	if (m_cap < 0)
+		return false;
+
+	// Every access to the DMA controller's registers goes through the
+	// CPU's debug port, and so halts the CPU.  If the CPU was running
+	// before we started, let it go again once we are done.
+	ctrl = m_fpga->readio(R_ZIPCTRL);
+	try {
+		r = calculate(a, len, crc);
+	} catch(BUSERR b) {
+		if ((ctrl & CPU_HALT)==0)
+			m_fpga->writeio(R_ZIPCTRL, CPU_GO);
+		throw;
+	}
+
+	if ((ctrl & CPU_HALT)==0)
+		m_fpga->writeio(R_ZIPCTRL, CPU_GO);
+	return r;
+}
+
+bool	DMACRC::calculate(const uint32 a, const int len, uint32_t &crc) {
+	BUSOP		ops[8];
+	uint32		status;
+
+	if (!supported())
+		return false;
+	if (len <= 0) {
+		crc = 0;
+		return true;
+	}
+
+	// Seeding the CRC also sets up the next transfer to be CRC-only
+	ops[0] = BUSOP(true, R_ZIPCTRL, CPU_DMACRC);
+	ops[1] = BUSOP(true, R_ZIPDATA, 0xffffffff);
+	ops[2] = BUSOP(true, R_ZIPCTRL, CPU_DMALEN);
+	ops[3] = BUSOP(true, R_ZIPDATA, len);
+	ops[4] = BUSOP(true, R_ZIPCTRL, CPU_DMASRC);
+	ops[5] = BUSOP(true, R_ZIPDATA, a);
+	ops[6] = BUSOP(true, R_ZIPCTRL, CPU_DMACTRL);
+	ops[7] = BUSOP(true, R_ZIPDATA, DMA_START);
+	m_fpga->transact(ops, 8);
+
+	// Now wait for it to finish, picking up the CRC along with each
+	// status check so that we won't need to go back for it
+	do {
+		ops[0] = BUSOP(true,  R_ZIPCTRL, CPU_DMACTRL);
+		ops[1] = BUSOP(false, R_ZIPDATA);
+		ops[2] = BUSOP(true,  R_ZIPCTRL, CPU_DMACRC);
+		ops[3] = BUSOP(false, R_ZIPDATA);
+		m_fpga->transact(ops, 4);
+		status = ops[1].data;
+	} while(status & DMA_BUSY);
+
+	if (status & DMA_ERR) {
+		// The source address register tells us where it stopped
+		ops[0] = BUSOP(true,  R_ZIPCTRL, CPU_DMASRC);
+		ops[1] = BUSOP(false, R_ZIPDATA);
+		m_fpga->transact(ops, 2);
+		throw BUSERR(ops[1].data);
+	}
+
+	crc = ~ops[3].data;
+	return true;
+}
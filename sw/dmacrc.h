@@ -0,0 +1,82 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	dmacrc.h
+//
+// Project:	XuLA2-LX25 SoC based upon the ZipCPU
+//
+// Purpose:	To check the contents of a memory on the board without reading
+//		it all back across the debugging bus.  The ZipSystem's DMA
+//	controller can read through a block of memory, calculating a CRC-32
+//	of it as it goes, without writing it anywhere.  Only that CRC then
+//	needs to come back to us, where it may be compared against a CRC of
+//	what the memory should hold.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015-2017, Gisselquist Technology, LLC
+//
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of  the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+//
+// License:	GPL, v3, as defined and found on www.gnu.org,
+//		http://www.gnu.org/licenses/gpl.html
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	DMACRC_H
+#define	DMACRC_H
+
+#include <stdint.h>
+#include "devbus.h"
+
+// The CRC-32 of len words, taking the bytes of each word from the most
+// significant byte down--just as the DMA controller does.  As with zlib's
+// crc32(), crc is the CRC of whatever came before buf, if anything.
+extern	uint32_t crc32w(const int len, const uint32_t *buf,
+			const uint32_t crc = 0);
+
+class	DMACRC {
+private:
+	DEVBUS	*m_fpga;
+	// Whether or not the board's DMA controller can calculate CRCs: zero
+	// if we don't know yet, one if it can, or negative if it can't
+	int	m_cap;
+
+	// Returns true if the board can calculate CRCs for us.  Asking
+	// leaves the DMA controller set up for a CRC, so this is only ever
+	// asked right before calculating one.
+	bool	supported(void);
+	// Does the work of crc(), below, leaving the CPU halted
+	bool	calculate(const uint32 a, const int len, uint32_t &crc);
+public:
+	DMACRC(DEVBUS *fpga) : m_fpga(fpga), m_cap(0) {}
+
+	// Have the board calculate the CRC-32 of the len words starting at
+	// address a.  Returns false, leaving crc alone, if it can't.  Any bus
+	// error the DMA controller runs into is thrown as a BUSERR.
+	//
+	// The DMA controller can only be reached through the ZipCPU's debug
+	// port, so the CPU is halted while the CRC is calculated.  A CPU that
+	// was running beforehand is set going again once the CRC is done (or
+	// has failed), while one that was halted is left that way.
+	bool	crc(const uint32 a, const int len, uint32_t &crc);
+};
+
+#endif
@@ -80,7 +80,21 @@ int main(int argc, char **argv) {
 	unsigned	sz;
 
 	if (vector_read) {
-		m_fpga->readi(DUMPMEM, BUFLN, buf);
+		// Read in blocks, keeping the next block on its way while
+		// we wait on the one before it
+		const int	BLKLN = 1024;
+		int		h[2], nb = (BUFLN+BLKLN-1)/BLKLN;
+
+		for(int k=0; k<nb; k++) {
+			int	ln = (BUFLN-k*BLKLN > BLKLN) ? BLKLN : BUFLN-k*BLKLN;
+			h[k&1] = m_fpga->submit_readi(DUMPMEM+k*BLKLN*4, ln,
+					&buf[k*BLKLN]);
+			if (k > 0) {
+				m_fpga->wait_read(h[(k-1)&1]);
+				printf("\rRead %6d of %6d words", k*BLKLN, BUFLN);
+				fflush(stdout);
+			}
+		} m_fpga->wait_read(h[(nb-1)&1]);
 	} else {
 		for(int i=0; i<BUFLN; i++) {
 			buf[i] = m_fpga->readio(DUMPMEM+i);
@@ -6,6 +6,12 @@
 //
 // Purpose:	Read local memory, dump into a file.
 //
+//	Alternatively, with -c, the file is still written into memory as
+//	before, but it is then checked by comparing a CRC the board calculates
+//	of that memory against one calculated here, rather than by reading it
+//	all back.  Only the CRC then needs to come back across the bus, and
+//	no output file is written.
+//
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -50,6 +56,7 @@
 #include "usbi.h"
 #include "port.h"
 #include "regdefs.h"
+#include "dmacrc.h"
 
 FPGA	*m_fpga;
 
@@ -58,9 +65,12 @@ int main(int argc, char **argv) {
 	unsigned	pos=0;
 	int		port = FPGAPORT, skp;
 	const int	BUFLN = 127;
+	const unsigned	MAXRAM = SDRAMBASE*2;
 	FPGA::BUSW	*buf = new FPGA::BUSW[BUFLN],
+			*nxt = new FPGA::BUSW[BUFLN],
 			*cmp = new FPGA::BUSW[BUFLN];
-	bool		use_usb = true;
+	bool		use_usb = true, crc_verify = false;
+	uint32_t	crc = 0;
 
 	skp = 1;
 	for(int argn=0; argn<argc-skp; argn++) {
@@ -71,13 +81,16 @@ int main(int argc, char **argv) {
 				use_usb = false;
 				if (isdigit(argv[argn+skp][2]))
 					port = atoi(&argv[argn+skp][2]);
-			} skp++; argn--;
+			} else if (argv[argn+skp][1] == 'c')
+				crc_verify = true;
+			skp++; argn--;
 		} else
 			argv[argn] = argv[argn+skp];
 	} argc -= skp;
 
-	if (argc!=2) {
+	if (argc != ((crc_verify)?1:2)) {
 		printf("Usage: dumpsdram [-p [port]] srcfile outfile\n");
+		printf("       dumpsdram [-p [port]] -c srcfile\n");
 		exit(-1);
 	}
 
@@ -104,21 +117,41 @@ int main(int argc, char **argv) {
 		pos = SDRAMBASE;
 		do {
 			nr = BUFLN;
-			if (nr + pos > SDRAMBASE*2)
-				nr = SDRAMBASE*2 - pos;
+			if (pos + (nr<<2) > MAXRAM)
+				nr = (MAXRAM - pos)>>2;
 			nr = fread(buf, sizeof(FPGA::BUSW), nr, fpin);
 			if (nr <= 0)
 				break;
 
 			if (false) {
 				for(int i=0; i<nr; i++)
-					m_fpga->writeio(pos+i, buf[i]);
+					m_fpga->writeio(pos+(i<<2), buf[i]);
 			} else
 				m_fpga->writei(pos, nr, buf);
-			pos += nr;
-		} while((nr > 0)&&(pos < 2*SDRAMBASE));
+			crc = crc32w(nr, buf, crc);
+			pos += (nr<<2);
+		} while((nr > 0)&&(pos < MAXRAM));
 
 		printf("SUCCESS::fully wrote full file to memory (pos = %08x)\n", pos);
+
+		if (crc_verify) {
+			uint32_t	bcrc;
+			DMACRC		dmacrc(m_fpga);
+
+			if (!dmacrc.crc(SDRAMBASE, (pos-SDRAMBASE)>>2, bcrc)) {
+				fprintf(stderr, "This board can\'t check its memory by CRC\n");
+				exit(-1);
+			} else if (bcrc != crc) {
+				printf("CRC MISMATCH: %08x(memory) != %08x(file).  (Failed test)\n",
+					bcrc, crc);
+				exit(-2);
+			}
+
+			printf("CRC %08x matches the %d words written\n",
+				crc, (pos-SDRAMBASE)>>2);
+			delete	m_fpga;
+			exit(0);
+		}
 	} catch(BUSERR a) {
 		fprintf(stderr, "BUS Err while writing at address 0x%08x\n", a.addr);
 		fprintf(stderr, "... is your program too long for this memory?\n");
@@ -141,23 +174,26 @@ int main(int argc, char **argv) {
 	// Read it back from memory
 	try {
 		pos = SDRAMBASE;
-		const unsigned int MAXRAM = SDRAMBASE*2;
 		bool	mismatch = false;
 		unsigned	total_reread = 0;
-		do {
-			int nw, nr;
-			if (MAXRAM-pos > BUFLN)
-				nr = BUFLN;
-			else
-				nr = MAXRAM-pos;
+		int	nr, nxtnr = 0, h, nxth = 0;
 
-			if (false) {
-				for(int i=0; i<nr; i++)
-					buf[i] = m_fpga->readio(pos+i);
-			} else
-				m_fpga->readi(pos, nr, buf);
+		nr = ((MAXRAM-pos)>>2 > (unsigned)BUFLN) ? BUFLN : (MAXRAM-pos)>>2;
+		h = m_fpga->submit_readi(pos, nr, buf);
+		do {
+			int nw;
+
+			// Start reading the next block, so that it can be on
+			// its way while we check this one
+			if (pos+(nr<<2) < MAXRAM) {
+				nxtnr = ((MAXRAM-pos)>>2)-nr;
+				if (nxtnr > BUFLN)
+					nxtnr = BUFLN;
+				nxth = m_fpga->submit_readi(pos+(nr<<2), nxtnr, nxt);
+			}
+			m_fpga->wait_read(h);
 
-			pos += nr;
+			pos += (nr<<2);
 			nw = fwrite(buf, sizeof(FPGA::BUSW), nr, fp);
 			if (nw < nr) {
 				printf("Only wrote %d of %d words!\n", nw, nr);
@@ -171,8 +207,8 @@ int main(int argc, char **argv) {
 			for(int i=0; i<cr; i++)
 				if (cmp[i] != buf[i]) {
 					printf("MISMATCH: MEM[%08x] = %08x(read) != %08x(expected)\n",
-						pos-nr+i, buf[i], cmp[i]);
-					mmaddr[mmidx] = pos-nr+i;
+						pos-((nr-i)<<2), buf[i], cmp[i]);
+					mmaddr[mmidx] = pos-((nr-i)<<2);
 					mmval[mmidx] = cmp[i];
 					if (mmidx < 65536)
 						mmidx++;
@@ -183,13 +219,16 @@ int main(int argc, char **argv) {
 				break;
 			}
 			}
+
+			{ FPGA::BUSW *tmp = buf; buf = nxt; nxt = tmp; }
+			h = nxth; nr = nxtnr;
 		} while(pos < MAXRAM);
 		if (mismatch)
 			printf("Read %04x (%6d) words from memory.  These did not match the source file.  (Failed test)\n",
-				pos-SDRAMBASE, pos-SDRAMBASE);
+				(pos-SDRAMBASE)>>2, (pos-SDRAMBASE)>>2);
 		else
 			printf("Successfully  read&copied %04x (%6d) words from memory\n",
-				pos-SDRAMBASE, pos-SDRAMBASE);
+				(pos-SDRAMBASE)>>2, (pos-SDRAMBASE)>>2);
 	} catch(BUSERR a) {
 		fprintf(stderr, "BUS Err at address 0x%08x\n", a.addr);
 		fprintf(stderr, "... is your program too long for this memory?\n");
@@ -0,0 +1,263 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	flashbench.cpp
+//
+// Project:	XuLA2-LX25 SoC based upon the ZipCPU
+//
+// Purpose:	To measure how long it takes the flash driver to erase and
+//		program a sector of flash, both in its normal mode, where it
+//	waits for each erase and program to complete before reading the result
+//	back, and in its high speed mode, where it doesn't.
+//
+//	The sectors used are overwritten with random data, but their original
+//	contents are read first and written back once we are done.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015-2017, Gisselquist Technology, LLC
+//
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of  the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+//
+// License:	GPL, v3, as defined and found on www.gnu.org,
+//		http://www.gnu.org/licenses/gpl.html
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <strings.h>
+#include <ctype.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "llcomms.h"
+#include "usbi.h"
+#include "port.h"
+#include "regdefs.h"
+#include "flashdrvr.h"
+#include "byteswap.h"
+
+FPGA		*m_fpga;
+
+void	closeup(int v) {
+	m_fpga->kill();
+	exit(0);
+}
+
+double	now(void) {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//
+// bench
+//
+// Erase and then program each of nsectors sectors, starting at addr, with
+// random data, and report the average time per sector for each.  Returns
+// the average total time per sector, or a negative number on any failure.
+double	bench(FLASHDRVR *flash, const char *name, const unsigned addr,
+		const int nsectors, char *buf) {
+	double	terase = 0.0, tprog = 0.0;
+
+	for(int k=0; k<nsectors; k++) {
+		unsigned	s = addr + k*SECTORSZB;
+		double		start, mid;
+
+		for(int i=0; i<SECTORSZB; i++)
+			buf[i] = rand();
+
+		start = now();
+		if (!flash->erase_sector(s, true)) {
+			fprintf(stderr, "Could not erase sector 0x%08x\n", s);
+			return -1.0;
+		}
+		mid = now();
+		for(int p=0; p<NPAGES; p++) {
+			if (!flash->page_program(s+p*PGLENB, PGLENB,
+					&buf[p*PGLENB], true)) {
+				fprintf(stderr, "Could not program page 0x%08x\n",
+					s+p*PGLENB);
+				return -1.0;
+			}
+		}
+		terase += mid - start;
+		tprog  += now() - mid;
+	}
+
+	printf("%-10s %10.1f %10.1f %10.1f\n", name,
+		terase/nsectors*1e3, tprog/nsectors*1e3,
+		(terase+tprog)/nsectors*1e3);
+	return (terase+tprog)/nsectors;
+}
+
+//
+// bench_write
+//
+// Write nsectors sectors of random data, starting at addr, through
+// FLASHDRVR::write(), planning and all, and report the average time per
+// sector.  Returns that average, or a negative number on any failure.
+double	bench_write(FLASHDRVR *flash, const char *name, const unsigned addr,
+		const int nsectors, char *img) {
+	double	start, t;
+
+	for(int i=0; i<nsectors*SECTORSZB; i++)
+		img[i] = rand();
+
+	start = now();
+	if (!flash->write(addr, nsectors*SECTORSZB, img, true)) {
+		fprintf(stderr, "Could not write 0x%08x\n", addr);
+		return -1.0;
+	} t = now() - start;
+
+	printf("%-10s %10.1f\n", name, t/nsectors*1e3);
+	return t/nsectors;
+}
+
+void	usage(void) {
+	printf("USAGE: flashbench [-u] [-p[port]] [-c] [-n sectors] -a address\n"
+"\n"
+"\tMeasures how long the flash takes to erase and program a sector,\n"
+"\tboth a page at a time and through a whole write().\n"
+"\n"
+"\t-u\tConnect via the USB-JTAG port (the default)\n"
+"\t-p\tConnect via a network port, such as that of netusb.  The port\n"
+"\t\tnumber may follow, as in -p%d\n"
+"\t-c\tVerify by having the board calculate a CRC, rather than\n"
+"\t\tby reading everything back\n"
+"\t-a\tThe address of the first flash sector to use.  This must be\n"
+"\t\tgiven.  These sectors are restored when the test is done.\n"
+"\t-n\tThe number of sectors to use for each test.\n",
+		FPGAPORT);
+}
+
+int main(int argc, char **argv) {
+	int		skp=0, port = FPGAPORT, nsectors = 4;
+	bool		use_usb = true, crc_verify = false;
+	unsigned	addr = 0;
+	char		*orig, *buf, *img;
+	double		tnormal, tfast;
+	LLCOMMSI	*comms;
+	FLASHDRVR	*flash;
+
+	skp=1;
+	for(int argn=0; argn<argc-skp; argn++) {
+		if (argv[argn+skp][0] == '-') {
+			if (argv[argn+skp][1] == 'u')
+				use_usb = true;
+			else if (argv[argn+skp][1] == 'p') {
+				use_usb = false;
+				if (isdigit(argv[argn+skp][2]))
+					port = atoi(&argv[argn+skp][2]);
+			} else if (argv[argn+skp][1] == 'c')
+				crc_verify = true;
+			else if ((argv[argn+skp][1] == 'a')
+					||(argv[argn+skp][1] == 'n')) {
+				if (argn+skp+1 >= argc) {
+					usage();
+					exit(EXIT_FAILURE);
+				}
+				if (argv[argn+skp][1] == 'a')
+					addr = strtoul(argv[argn+skp+1], NULL, 0);
+				else
+					nsectors = atoi(argv[argn+skp+1]);
+				skp++; argn--;
+			} else {
+				usage();
+				exit(EXIT_SUCCESS);
+			}
+			skp++; argn--;
+		} else
+			argv[argn] = argv[argn+skp];
+	} argc -= skp;
+
+	if ((argc != 0)||(nsectors <= 0)||(addr < SPIFLASH)
+			||(addr != SECTOROF(addr))
+			||(addr + nsectors*SECTORSZB > SPIFLASH + FLASHBYTES)) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if (use_usb)
+		comms = new USBI();
+	else
+		comms = new NETCOMMS(FPGAHOST, port);
+	m_fpga = new FPGA(comms);
+	flash = new FLASHDRVR(m_fpga);
+	flash->set_crc_verify(crc_verify);
+
+	signal(SIGSTOP, closeup);
+	signal(SIGHUP, closeup);
+
+	orig = new char[nsectors*SECTORSZB];
+	buf  = new char[SECTORSZB];
+	img  = new char[nsectors*SECTORSZB];
+	srand(time(NULL));
+
+	try {
+		m_fpga->readi(addr, (nsectors*SECTORSZB)>>2, (uint32_t *)orig);
+		byteswapbuf((nsectors*SECTORSZB)>>2, (uint32_t *)orig);
+
+		printf("%-10s %10s %10s %10s\n", "MODE", "Erase(ms)",
+			"Prog(ms)", "Sector(ms)");
+		flash->set_high_speed(false);
+		tnormal = bench(flash, "Normal", addr, nsectors, buf);
+		flash->set_high_speed(true);
+		tfast   = bench(flash, "HighSpeed", addr, nsectors, buf);
+		if ((tnormal > 0.0)&&(tfast > 0.0))
+			printf("\nHigh speed mode is %.2fx as fast\n",
+				tnormal/tfast);
+
+		// Now the same, but through write(), which plans each sector
+		// before erasing and programming it
+		printf("\n%-10s %10s\n", "WRITE()", "Sector(ms)");
+		flash->set_high_speed(false);
+		tnormal = bench_write(flash, "Normal", addr, nsectors, img);
+		flash->set_high_speed(true);
+		tfast   = bench_write(flash, "HighSpeed", addr, nsectors, img);
+		if ((tnormal > 0.0)&&(tfast > 0.0))
+			printf("\nHigh speed mode is %.2fx as fast\n",
+				tnormal/tfast);
+
+		printf("\nRestoring the original contents\n");
+		flash->set_high_speed(false);
+		if (!flash->write(addr, nsectors*SECTORSZB, orig, true))
+			fprintf(stderr, "Could not restore the flash!\n");
+	} catch(BUSERR b) {
+		fprintf(stderr, "BUS ERROR at address 0x%08x\n", b.addr);
+		delete	m_fpga;
+		exit(EXIT_FAILURE);
+	}
+
+	printf("\nTotal: %ld characters written, %ld read\n",
+		comms->m_total_nwrit, m_fpga->m_total_nread);
+
+	delete[] orig;
+	delete[] buf;
+	delete[] img;
+	delete	flash;
+	delete	m_fpga;
+}
@@ -45,13 +45,21 @@
 #include <string.h>
 #include <signal.h>
 #include <assert.h>
+#include <time.h>
 
 #include "port.h"
 #include "regdefs.h"
 #include "flashdrvr.h"
 #include "byteswap.h"
+#include "dmacrc.h"
 
-const	bool	HIGH_SPEED = false;
+// The number of words read back from a sector the cache says already
+// matches, to confirm that it really does
+#define	SAMPLEW		16
+
+// The longest we'll sleep waiting for a flash interrupt before checking
+// the flash for ourselves, in milliseconds
+#define	FLWAITMS	400
 
 #define	SETSCOPE
 // #define SETSCOPE m_fpga->writeio(R_QSCOPE, 8180)
@@ -75,7 +83,12 @@ void	FLASHDRVR::flwait(void) {
 		// wait for an interrupt.
 		v = m_fpga->readio(R_QSPI_EREG);
 		if (v&ERASEFLAG) {
-			m_fpga->usleep(400);
+			// The interrupt may also have arrived along with that
+			// last read, in which case there's nothing more to wait
+			// for.  Otherwise sleep until it arrives, or until
+			// FLWAITMS passes should it get lost.
+			if (!m_fpga->poll())
+				m_fpga->usleep(FLWAITMS);
 			if (m_fpga->poll()) {
 				m_fpga->clear();
 				m_fpga->writeio(R_ICONTROL, ISPIF_EN);
@@ -84,19 +97,177 @@ void	FLASHDRVR::flwait(void) {
 	} while(v & ERASEFLAG);
 }
 
+//
+// sector_hash
+//
+// A 64-bit FNV-1a hash of one sector's worth of bytes.  This only needs to
+// tell whether a sector has changed since we last saw it, not to stand up
+// to anyone trying to fool it.
+static	uint64_t	sector_hash(const char *buf) {
+	uint64_t	h = 0xcbf29ce484222325ull;
+
+	for(unsigned i=0; i<SECTORSZB; i++) {
+		h ^= (unsigned char)buf[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+//
+// plan_pages
+//
+// Count the pages a plan will program, and the bytes within them
+static	unsigned	plan_pages(const FLASHPLAN *pl, unsigned *nbytes) {
+	unsigned	npages = 0;
+
+	for(unsigned p=0; p<NPAGES; p++) {
+		if (pl->m_pages & (1u<<p)) {
+			npages++;
+			*nbytes += pl->m_pglen[p];
+		}
+	}
+	return npages;
+}
+
+// Which of our cache entries holds the sector containing address a, or -1 if
+// that address isn't in the flash at all
+int	FLASHDRVR::cache_index(const unsigned a) {
+	if ((a < SPIFLASH)||(a >= SPIFLASH + FLASHBYTES))
+		return -1;
+	return (a - SPIFLASH) / SECTORSZB;
+}
+
+// Forget what the sector containing a holds, both here and on disk, since
+// we're about to change it.  Should we then fail, or be killed, before
+// learning what it holds, the next run mustn't trust what we knew before.
+void	FLASHDRVR::cache_forget(const unsigned a) {
+	int	idx = cache_index(a);
+
+	cache_load();
+	if ((idx >= 0)&&(m_cvalid[idx])) {
+		m_cvalid[idx] = false;
+		cache_save();
+	}
+}
+
+//
+// cache_load
+//
+// Read our sector hashes back from the disk.  The cache file belongs to one
+// flash device (by its ID) as it was last written with one configuration
+// (by its version), so hashes from any other board or design are ignored.
+// The file is $HOME/.xulaflash-<id>-<version> unless the FLASHCACHE
+// environment variable names another.  Setting FLASHCACHE to an empty string
+// turns the cache off.
+//
+// This is only done once, the first time the cache is needed.  From then on,
+// what we hold here is kept up to date, and is newer than what's on disk.
+void	FLASHDRVR::cache_load(void) {
+	const char	*path;
+	FILE		*fp;
+	unsigned	id, ver, a;
+	unsigned long long	h;
+
+	if (m_cloaded)
+		return;
+	m_cloaded = true;
+
+	path = getenv("FLASHCACHE");
+	if ((path)&&(path[0] == '\0'))
+		return;
+
+	m_cid  = m_fpga->readio(R_QSPI_IDREG);
+	m_cver = m_fpga->readio(R_VERSION);
+	if (path)
+		m_cachefile = strdup(path);
+	else if (NULL != (path = getenv("HOME"))) {
+		m_cachefile = (char *)malloc(strlen(path)+32);
+		sprintf(m_cachefile, "%s/.xulaflash-%08x-%08x", path,
+			m_cid, m_cver);
+	} else
+		return;
+
+	fp = fopen(m_cachefile, "r");
+	if (!fp)
+		return;
+	if ((fscanf(fp, "XULAFLASH %x %x\n", &id, &ver) != 2)
+			||(id != m_cid)||(ver != m_cver)) {
+		if (m_debug) printf("Ignoring flash cache, %s\n", m_cachefile);
+		fclose(fp);
+		return;
+	}
+
+	while(fscanf(fp, "%x %llx\n", &a, &h) == 2) {
+		int	idx = cache_index(a);
+		if (idx < 0)
+			continue;
+		m_cvalid[idx] = true;
+		m_chash[idx]  = h;
+	} fclose(fp);
+}
+
+void	FLASHDRVR::cache_save(void) {
+	FILE	*fp;
+
+	if (!m_cachefile)
+		return;
+
+	fp = fopen(m_cachefile, "w");
+	if (!fp) {
+		fprintf(stderr, "Could not write flash cache, %s\n",
+			m_cachefile);
+		return;
+	}
+
+	fprintf(fp, "XULAFLASH %08x %08x\n", m_cid, m_cver);
+	for(int i=0; i<FLCACHESECTORS; i++) {
+		if (m_cvalid[i])
+			fprintf(fp, "%08x %016llx\n", SPIFLASH+i*SECTORSZB,
+				(unsigned long long)m_chash[i]);
+	} fclose(fp);
+}
+
+//
+// crc_matches
+//
+// Check the len words starting at addr against buf by CRC, if we've been
+// asked to and the board can.  Returns 1 if they match, 0 if they don't, or
+// -1 if they'll need to be read back and compared instead.
+int	FLASHDRVR::crc_matches(const unsigned addr, const int len,
+		const uint32_t *buf) {
+	uint32_t	crc;
+
+	if ((!m_crc)||(!m_crc->crc(addr, len, crc)))
+		return -1;
+	if (crc == crc32w(len, buf))
+		return 1;
+	printf("\nCRC FAILS: %08x - %08x\n", addr, addr+(len<<2)-1);
+	return 0;
+}
+
 bool	FLASHDRVR::erase_sector(const unsigned sector, const bool verify_erase) {
-	DEVBUS::BUSW	page[SZPAGEW];
+	erase_start(sector);
+	return erase_check(sector, verify_erase);
+}
 
+// Command the erase of a sector, but don't wait for it
+void	FLASHDRVR::erase_start(const unsigned sector) {
 	if (m_debug) printf("Erasing sector: %08x\n", sector);
+	cache_forget(sector);
 	m_fpga->writeio(R_QSPI_EREG, DISABLEWP);
 	m_fpga->writeio(R_QSPI_EREG, ERASEFLAG + (sector>>2));
+}
+
+// Wait for an erase started by erase_start() to complete, and verify it
+bool	FLASHDRVR::erase_check(const unsigned sector, const bool verify_erase) {
+	DEVBUS::BUSW	page[SZPAGEW];
 
 	// If we're in high speed mode and we want to verify the erase, then
 	// we can skip waiting for the erase to complete by issueing a read
 	// command immediately.  As soon as the erase completes the read will
 	// begin sending commands back.  This allows us to recover the lost 
 	// time between the interrupt and the next command being received.
-	if  ((!HIGH_SPEED)||(!verify_erase)) {
+	if  ((!m_high_speed)||(!verify_erase)) {
 		flwait();
 
 		if (m_debug) {
@@ -111,6 +282,16 @@ bool	FLASHDRVR::erase_sector(const unsigned sector, const bool verify_erase) {
 
 	// Now, let's verify that we erased the sector properly
 	if (verify_erase) {
+		static	uint32_t	erased[SECTORSZB>>2];
+		int	m;
+
+		if (erased[0] == 0) {
+			for(int i=0; i<(SECTORSZB>>2); i++)
+				erased[i] = 0xffffffff;
+		}
+		if ((m = crc_matches(sector, SECTORSZB>>2, erased)) >= 0)
+			return (m > 0);
+
 		for(int i=0; i<NPAGES; i++) {
 			m_fpga->readi(sector+i*SZPAGEW, SZPAGEW, page);
 			for(int i=0; i<SZPAGEW; i++)
@@ -132,6 +313,7 @@ bool	FLASHDRVR::page_program(const unsigned addr, const unsigned len,
 
 	if (len <= 0)
 		return true;
+	cache_forget(addr);
 
 	bool	empty_page = true;
 	for(unsigned i=0; i<len; i+=4) {
@@ -159,10 +341,15 @@ bool	FLASHDRVR::page_program(const unsigned addr, const unsigned len,
 		// completes the read will begin sending commands back.  This
 		// allows us to recover the lost time between the interrupt and
 		// the next command being received.
-		flwait();
+		if ((!m_high_speed)||(!verify_write))
+			flwait();
 	}
-	// if ((!HIGH_SPEED)||(!verify_write)) { }
 	if (verify_write) {
+		int	m;
+
+		if ((m = crc_matches(addr, len>>2, bswapd)) >= 0)
+			return (m > 0);
+
 		// printf("Attempting to verify page\n");
 		// NOW VERIFY THE PAGE
 		m_fpga->readi(addr, len>>2, buf);
@@ -177,76 +364,272 @@ bool	FLASHDRVR::page_program(const unsigned addr, const unsigned len,
 	} return true;
 }
 
+//
+// plan_sector
+//
+// Given cur, the sector's present contents, decide what it will take to
+// place the len bytes of data, starting at addr, into it.  The sector only
+// needs to be erased if some bit needs to go from a zero to a one.  Once
+// we know that, each page only needs the words programmed that differ from
+// what the page will hold beforehand: its present contents, or all ones if
+// we are erasing it.  Pages that already match, or that would be programmed
+// to all ones following an erase, are left alone.
+void	FLASHDRVR::plan_sector(FLASHPLAN *pl, const char *cur,
+		const unsigned addr, const unsigned len, const char *data) {
+	unsigned	s = pl->m_addr, base, ln;
+	char		*want;
+
+	base = (addr>s)?addr:s;
+	ln=((addr+len>s+SECTORSZB)?(s+SECTORSZB):(addr+len))-base;
+
+	want = new char[SECTORSZB];
+	memcpy(want, cur, SECTORSZB);
+	memcpy(&want[base-s], &data[base-addr], ln);
+
+	pl->m_data  = want;
+	pl->m_erase = false;
+	pl->m_pages = 0;
+	for(unsigned i=0; i<SECTORSZB; i++) {
+		if ((cur[i]&want[i]) != want[i]) {
+			if (m_debug)
+				printf("NEED-ERASE @0x%08x ... %02x != %02x (Goal)\n",
+					s+i, cur[i]&0x0ff, want[i]&0x0ff);
+			pl->m_erase = true;
+			break;
+		}
+	}
+
+	for(unsigned p=0; p<NPAGES; p++) {
+		int	first = -1, last = -1;
+
+		for(unsigned i=p*SZPAGEB; i<(p+1)*SZPAGEB; i++) {
+			char	was = (pl->m_erase) ? (char)0x0ff : cur[i];
+			if (want[i] != was) {
+				if (first < 0)
+					first = i;
+				last = i;
+			}
+		}
+
+		if (first < 0)
+			continue;
+		pl->m_pages |= (1u<<p);
+		pl->m_pgoff[p] = first & -4;
+		pl->m_pglen[p] = (last|3) + 1 - (first & -4);
+	}
+}
+
+//
+// submit_check
+//
+// Start reading back whatever we'll need of the sector at pl->m_addr in
+// order to plan it, into cur, and return the handle of that read.  If the
+// image covers the whole sector, and the cache says the sector already holds
+// exactly that, then we only read back SAMPLEW words from somewhere within
+// it to make sure the cache isn't stale.  Otherwise we read the whole sector.
+int	FLASHDRVR::submit_check(FLASHPLAN *pl, char *cur,
+		const unsigned addr, const unsigned len, const char *data) {
+	unsigned	s = pl->m_addr;
+	int		idx = cache_index(s);
+
+	pl->m_cached = (idx >= 0)&&(m_cvalid[idx])
+			&&(s >= addr)&&(s+SECTORSZB <= addr+len)
+			&&(m_chash[idx] == sector_hash(&data[s-addr]));
+	if (pl->m_cached) {
+		static	unsigned	seed = 0;
+
+		if (seed == 0)
+			seed = (unsigned)time(NULL);
+		seed = seed * 1103515245u + 12345u;
+		pl->m_sample = ((seed>>8) % (SECTORSZB/4 - SAMPLEW + 1))*4;
+		return m_fpga->submit_readi(s+pl->m_sample, SAMPLEW,
+				(uint32_t *)&cur[pl->m_sample]);
+	}
+
+	return m_fpga->submit_readi(s, SECTORSZB>>2, (uint32_t *)cur);
+}
+
+//
+// finish_check
+//
+// Wait for the read started by submit_check() to complete, and then plan out
+// the sector from what it read.
+void	FLASHDRVR::finish_check(FLASHPLAN *pl, char *cur, const int h,
+		const unsigned addr, const unsigned len, const char *data) {
+	m_fpga->wait_read(h);
+
+	if (pl->m_cached) {
+		byteswapbuf(SAMPLEW, (uint32_t *)&cur[pl->m_sample]);
+		if (0 == memcmp(&cur[pl->m_sample],
+				&data[pl->m_addr+pl->m_sample-addr],
+				SAMPLEW*4))
+			return;
+
+		// The cache is stale.  Go back and read the whole sector
+		// after all.
+		printf("Flash cache is stale at 0x%08x\n", pl->m_addr);
+		cache_forget(pl->m_addr);
+		pl->m_cached = false;
+		m_fpga->readi(pl->m_addr, SECTORSZB>>2, (uint32_t *)cur);
+	}
+
+	byteswapbuf(SECTORSZB>>2, (uint32_t *)cur);
+	plan_sector(pl, cur, addr, len, data);
+}
+
+//
+// program_sector
+//
+// Carry out the plan for one sector.  If the sector needs erasing, the erase
+// must already have been started with erase_start().
+bool	FLASHDRVR::program_sector(FLASHPLAN *pl, const bool verify) {
+	unsigned	s = pl->m_addr;
+
+	if (!pl->m_erase) {
+		if (m_debug) printf("NO ERASE NEEDED\n");
+	} else if (!erase_check(s, verify)) {
+		printf("SECTOR ERASE FAILED!\n");
+		return false;
+	}
+
+	// Now program only those pages that differ from what the sector
+	// holds now
+	for(unsigned p=0; p<NPAGES; p++) {
+		unsigned	off = pl->m_pgoff[p];
+
+		if ((pl->m_pages & (1u<<p))==0)
+			continue;
+		if (!page_program(s+off, pl->m_pglen[p], &pl->m_data[off],
+				verify)) {
+			printf("WRITE-PAGE FAILED!\n");
+			return false;
+		}
+	}
+
+	printf("Sector 0x%08x: DONE%15s\n", s, "");
+	return true;
+}
+
 bool	FLASHDRVR::write(const unsigned addr, const unsigned len,
 		const char *data, const bool verify) {
-	// Work through this one sector at a time.
-	// If this buffer is equal to the sector value(s), go on
-	// If not, erase the sector
-
-	for(unsigned s=SECTOROF(addr); s<SECTOROF(addr+len+SECTORSZB-1);
-			s+=SECTORSZB) {
-		// Do we need to erase?
-		bool	need_erase = false, need_program = false;
-		unsigned newv = 0; // (s<addr)?addr:s;
-		{
-			char *sbuf = new char[SECTORSZB];
-			const char *dp;	// pointer to our "desired" buffer
-			unsigned	base,ln;
-
-			base = (addr>s)?addr:s;
-			ln=((addr+len>s+SECTORSZB)?(s+SECTORSZB):(addr+len))-base;
-			m_fpga->readi(base, ln>>2, (uint32_t *)sbuf);
-			byteswapbuf(ln>>2, (uint32_t *)sbuf);
-
-			dp = &data[base-addr];
-			SETSCOPE;
-			for(unsigned i=0; i<ln; i++) {
-				if ((sbuf[i]&dp[i]) != dp[i]) {
-					if (m_debug) {
-						printf("\nNEED-ERASE @0x%08x ... %08x != %08x (Goal)\n", 
-							i+base-addr, sbuf[i], dp[i]);
-					}
-					need_erase = true;
-					newv = (i&-4)+base;
-					break;
-				} else if ((sbuf[i] != dp[i])&&(newv == 0))
-					newv = (i&-4)+base;
-			}
+	// Work through this in two passes.  First, read back every sector the
+	// image touches (or just a sample of it, if the cache says it already
+	// matches) and work out which sectors need to be erased and which
+	// pages (or parts of pages) need to be programmed.  Only then go back
+	// and erase and program those, and nothing else.
+	//
+	// In high speed mode, we instead plan each sector as we come to it.
+	// The read of the next sector is then issued right behind the erase
+	// of this one, so that it comes back the moment the erase completes.
+	// Each sector's plan is then printed just before it is carried out,
+	// and the summary of them all only once they are done.
+	unsigned	nsectors, nerase = 0, npages = 0, nbytes = 0, ncached = 0;
+	FLASHPLAN	*plan;
+	char		*cur[2];
+	int		h[2];
+	bool		r = true;
+
+	if (len == 0)
+		return true;
+
+	nsectors = (SECTOROF(addr+len+SECTORSZB-1)-SECTOROF(addr))/SECTORSZB;
+	plan = new FLASHPLAN[nsectors];
+	cur[0] = new char[SECTORSZB];
+	cur[1] = new char[SECTORSZB];
+
+	cache_load();
+	for(unsigned k=0; k<nsectors; k++) {
+		plan[k].m_addr  = SECTOROF(addr) + k*SECTORSZB;
+		plan[k].m_data  = NULL;
+		plan[k].m_erase = false;
+		plan[k].m_pages = 0;
+		plan[k].m_cached = false;
+	}
+
+	SETSCOPE;
+	h[0] = submit_check(&plan[0], cur[0], addr, len, data);
+	for(unsigned k=0; (r)&&(k<nsectors); k++) {
+		FLASHPLAN	*pl = &plan[k];
+
+		// Keep the read of the next sector in flight while we compare
+		// the last one
+		if ((!m_high_speed)&&(k+1 < nsectors))
+			h[(k+1)&1] = submit_check(&plan[k+1], cur[(k+1)&1],
+					addr, len, data);
+		finish_check(pl, cur[k&1], h[k&1], addr, len, data);
+
+		if (!m_high_speed)
+			continue;
+
+		if ((pl->m_erase)||(pl->m_pages)) {
+			unsigned	nb = 0, np = plan_pages(pl, &nb);
+
+			printf("Sector 0x%08x: %s%d pages (%d bytes) to program\n",
+				pl->m_addr, (pl->m_erase)?"erase, ":"", np, nb);
+		}
+		if (pl->m_erase) {
+			printf("ERASING SECTOR: %08x\n", pl->m_addr);
+			erase_start(pl->m_addr);
 		}
+		if (k+1 < nsectors)
+			h[(k+1)&1] = submit_check(&plan[k+1], cur[(k+1)&1],
+					addr, len, data);
+		if ((pl->m_erase)||(pl->m_pages))
+			r = program_sector(pl, verify);
+	}
+
+	for(unsigned k=0; k<nsectors; k++) {
+		if ((plan[k].m_cached)&&(!plan[k].m_data))
+			ncached++;
+		if (plan[k].m_erase)
+			nerase++;
+		npages += plan_pages(&plan[k], &nbytes);
+	}
+
+	// In high speed mode, this is what was done, rather than what will be
+	if (m_high_speed)
+		printf("Flash 0x%08x-0x%08x: %d sectors (%d cached), %d erased, %d pages (%d bytes) programmed\n",
+			addr, addr+len-1, nsectors, ncached,
+			nerase, npages, nbytes);
+	else
+		printf("Flash 0x%08x-0x%08x: %d sectors (%d cached), %d to erase, %d pages (%d bytes) to program\n",
+			addr, addr+len-1, nsectors, ncached,
+			nerase, npages, nbytes);
 
-		if (newv == 0)
+	for(unsigned k=0; (!m_high_speed)&&(k<nsectors); k++) {
+		if ((!plan[k].m_erase)&&(plan[k].m_pages == 0))
 			continue; // This sector already matches
 
-		// Erase the sector if necessary
-		if (!need_erase) {
-			if (m_debug) printf("NO ERASE NEEDED\n");
-		} else {
-			printf("ERASING SECTOR: %08x\n", s);
-			if (!erase_sector(s, verify)) {
-				printf("SECTOR ERASE FAILED!\n");
-				return false;
-			} newv = (s<addr) ? addr : s;
+		if (plan[k].m_erase) {
+			printf("ERASING SECTOR: %08x\n", plan[k].m_addr);
+			erase_start(plan[k].m_addr);
+		}
+		if (!program_sector(&plan[k], verify)) {
+			r = false;
+			break;
 		}
-
-		// Now walk through all of our pages in this sector and write
-		// to them.
-		for(unsigned p=newv; (p<s+SECTORSZB)&&(p<addr+len); p=PAGEOF(p+PGLENB)) {
-			unsigned start = p, len = addr+len-start;
-
-			// BUT! if we cross page boundaries, we need to clip
-			// our results to the page boundary
-			if (PAGEOF(start+len-1)!=PAGEOF(start))
-				len = PAGEOF(start+PGLENB)-start;
-			if (!page_program(start, len, &data[p-addr], verify)) {
-				printf("WRITE-PAGE FAILED!\n");
-				return false;
-			}
-		} if ((need_erase)||(need_program))
-			printf("Sector 0x%08x: DONE%15s\n", s, "");
 	}
 
 	m_fpga->writeio(R_QSPI_EREG, ENABLEWP); // Re-enable write protection
+	delete[] cur[0];
+	delete[] cur[1];
 
-	return true;
-}
+	// Every sector we planned now holds what we planned for it, unless
+	// we failed part way through--in which case we no longer know what
+	// the sector we failed on holds.  erase_sector() and page_program()
+	// have already forgotten that one.
+	for(unsigned k=0; k<nsectors; k++) {
+		int	idx = cache_index(plan[k].m_addr);
+		if ((idx >= 0)&&(plan[k].m_data)&&((r)||(
+				(!plan[k].m_erase)&&(plan[k].m_pages == 0)))) {
+			m_cvalid[idx] = true;
+			m_chash[idx]  = sector_hash(plan[k].m_data);
+		}
+	} cache_save();
 
+	for(unsigned k=0; k<nsectors; k++)
+		delete[] plan[k].m_data;
+	delete[] plan;
+
+	return r;
+}
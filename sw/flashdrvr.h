@@ -40,16 +40,86 @@
 #ifndef	FLASHDRVR_H
 #define	FLASHDRVR_H
 
+#include <stdlib.h>
+#include <stdint.h>
 #include "regdefs.h"
+#include "dmacrc.h"
+
+// The number of sectors whose hashes we keep, see flashdrvr.cpp
+#define	FLCACHESECTORS	(FLASHBYTES/SECTORSZB)
+
+// What write() will do to one sector, worked out before the device is
+// touched.  m_data holds the sector as it should read once we are done: the
+// new image, laid over whatever the sector already held outside of it.  Each
+// page in m_pages is then programmed from m_pgoff[p] for m_pglen[p] bytes.
+typedef	struct	{
+	unsigned	m_addr;		// The first address of the sector
+	bool		m_erase;	// True if the sector must be erased first
+	unsigned	m_pages;	// One bit per page needing to be programmed
+	unsigned	m_pgoff[NPAGES], m_pglen[NPAGES];
+	char		*m_data;
+	// True if the cache says this sector already holds the image, so
+	// only the m_sample'th byte onwards was read back to confirm it
+	bool		m_cached;
+	unsigned	m_sample;
+} FLASHPLAN;
 
 class	FLASHDRVR {
 private:
 	DEVBUS	*m_fpga;
-	bool	m_debug;
+	bool	m_debug, m_high_speed;
+	// If set, verify by having the board calculate a CRC, rather than
+	// reading everything back
+	DMACRC	*m_crc;
+
+	// A hash of what each sector held when we last wrote or read it back,
+	// kept on disk in m_cachefile across runs.  m_cloaded is set once
+	// it's been read from there.
+	bool		m_cloaded;
+	char		*m_cachefile;
+	bool		m_cvalid[FLCACHESECTORS];
+	uint64_t	m_chash[FLCACHESECTORS];
+	unsigned	m_cid, m_cver;
 
 	void	flwait(void);
+	int	crc_matches(const unsigned addr, const int len,
+			const uint32_t *buf);
+	void	erase_start(const unsigned sector);
+	bool	erase_check(const unsigned sector, const bool verify_erase);
+	int	cache_index(const unsigned a);
+	void	cache_load(void);
+	void	cache_save(void);
+	void	cache_forget(const unsigned a);
+	int	submit_check(FLASHPLAN *pl, char *cur,
+			const unsigned addr, const unsigned len, const char *data);
+	void	finish_check(FLASHPLAN *pl, char *cur, const int h,
+			const unsigned addr, const unsigned len, const char *data);
+	bool	program_sector(FLASHPLAN *pl, const bool verify);
+	void	plan_sector(FLASHPLAN *pl, const char *cur,
+			const unsigned addr, const unsigned len, const char *data);
 public:
-	FLASHDRVR(DEVBUS *fpga) : m_fpga(fpga), m_debug(false) {}
+	FLASHDRVR(DEVBUS *fpga) : m_fpga(fpga), m_debug(false),
+			m_high_speed(false), m_crc(NULL), m_cloaded(false),
+			m_cachefile(NULL) {
+		for(int i=0; i<FLCACHESECTORS; i++)
+			m_cvalid[i] = false;
+	}
+	~FLASHDRVR(void) { free(m_cachefile); delete m_crc; }
+
+	// In high speed mode, we don't wait for an erase or a program to
+	// complete before reading the flash back to verify it.  The read
+	// simply stalls within the FPGA until the flash is ready.  write()
+	// also reads back the next sector while erasing the current one,
+	// rather than reading back every sector before erasing any.
+	void	set_high_speed(const bool hs) { m_high_speed = hs; }
+
+	// Verify erases and writes by comparing a CRC calculated on the board
+	// (see dmacrc.h), rather than by reading back every word.  If the
+	// board can't do this, we quietly go back to reading.
+	void	set_crc_verify(const bool v) {
+		delete m_crc;
+		m_crc = (v) ? new DMACRC(m_fpga) : NULL;
+	}
 	bool	erase_sector(const unsigned sector, const bool verify_erase=true);
 	bool	page_program(const unsigned addr, const unsigned len,
 			const char *data, const bool verify_write=true);
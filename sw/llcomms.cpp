@@ -56,8 +56,12 @@
 #include <strings.h> 
 #include <poll.h> 
 #include <ctype.h> 
+#include <sys/un.h>
+#include <sys/ioctl.h>
+#include <time.h>
 
 #include "llcomms.h"
+#include "shmlink.h"
 
 LLCOMMSI::LLCOMMSI(void) {
 	m_fdw = -1;
@@ -107,6 +111,12 @@ bool	LLCOMMSI::poll(unsigned ms) {
 }
 
 int	LLCOMMSI::available(void) {
+	int	nr;
+
+	// Ask the O/S how many bytes are waiting.  Sockets, pipes, and
+	// serial ports all know.  Should this fail, fall back to poll().
+	if (ioctl(m_fdr, FIONREAD, &nr) == 0)
+		return nr;
 	return poll(0)?1:0;
 }
 
@@ -173,3 +183,105 @@ void	NETCOMMS::close(void) {
 	}
 	::close(m_fdw);
 }
+
+UNIXCOMMS::UNIXCOMMS(const char *path) {
+	struct	sockaddr_un	serv_addr;
+
+	if ((m_fdr = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		printf("\n Error : Could not create socket \n");
+		exit(-1);
+	}
+
+	memset(&serv_addr, 0, sizeof(serv_addr));
+	serv_addr.sun_family = AF_UNIX;
+	strncpy(serv_addr.sun_path, path, sizeof(serv_addr.sun_path)-1);
+
+	if (connect(m_fdr,(struct sockaddr *)&serv_addr, sizeof(serv_addr))< 0){
+		perror("Connect Failed Err");
+		exit(-1);
+	}
+
+	m_fdw = m_fdr;
+}
+
+// How long to spin on a shared memory ring before going to sleep, and how
+// long to sleep for before looking again
+#define	SHM_SPINS	2000
+#define	SHM_NAP_NS	20000
+
+// Wait a moment for the other side of a shared memory link to do something.
+// Returns false if the server has gone away.
+static	bool	shm_wait(SHMLINK *lnk, unsigned &spins) {
+	if (spins < SHM_SPINS) {
+		spins++;
+		return true;
+	}
+
+	struct	timespec	ts;
+	ts.tv_sec = 0; ts.tv_nsec = SHM_NAP_NS;
+	nanosleep(&ts, NULL);
+	// Check on the server every so often, a couple times a second
+	if ((++spins & 0x3fff) == 0)
+		return (kill(lnk->m_server, 0) == 0);
+	return true;
+}
+
+SHMCOMMS::SHMCOMMS(const char *name) {
+	m_link = shmlink_attach(name);
+	if (!m_link)
+		exit(-1);
+}
+
+void	SHMCOMMS::close(void) {
+	if (m_link)
+		shmlink_detach(m_link);
+	m_link = NULL;
+}
+
+void	SHMCOMMS::write(char *buf, int len) {
+	unsigned	spins = 0;
+	int		nw = 0;
+
+	while(nw < len) {
+		int	ln = m_link->m_tofpga.write(&buf[nw], len-nw);
+		if (ln > 0) {
+			nw += ln;
+			spins = 0;
+		} else if (!shm_wait(m_link, spins))
+			throw "Write-Failure";
+	}
+	m_total_nwrit += nw;
+}
+
+int	SHMCOMMS::read(char *buf, int len) {
+	unsigned	spins = 0;
+	int		nr;
+
+	while(0 == (nr = m_link->m_fromfpga.read(buf, len))) {
+		if (!shm_wait(m_link, spins))
+			throw "Read-Failure";
+	}
+	m_total_nread += nr;
+	return nr;
+}
+
+bool	SHMCOMMS::poll(unsigned ms) {
+	struct	timespec	start, now;
+	unsigned		spins = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while(m_link->m_fromfpga.avail() == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((now.tv_sec - start.tv_sec)*1000
+				+ (now.tv_nsec - start.tv_nsec)/1000000
+				>= (long)ms)
+			return false;
+		if (!shm_wait(m_link, spins))
+			return false;
+	}
+	return true;
+}
+
+int	SHMCOMMS::available(void) {
+	return m_link->m_fromfpga.avail();
+}
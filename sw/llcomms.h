@@ -66,9 +66,32 @@ public:
 };
 
 class	NETCOMMS : public LLCOMMSI {
+protected:
+	NETCOMMS(void) {}
 public:
 	NETCOMMS(const char *dev, const int port);
 	virtual	void	close(void);
 };
 
+// A connection to a server on this same machine, through a Unix domain
+// socket at path.  This avoids the TCP stack altogether.
+class	UNIXCOMMS : public NETCOMMS {
+public:
+	UNIXCOMMS(const char *path);
+};
+
+// A connection to a server on this same machine, through the shared memory
+// link called name (see shmlink.h)
+struct	SHMLINK_S;
+class	SHMCOMMS : public LLCOMMSI {
+	struct	SHMLINK_S	*m_link;
+public:
+	SHMCOMMS(const char *name);
+	virtual	void	close(void);
+	virtual	void	write(char *buf, int len);
+	virtual int	read(char *buf, int len);
+	virtual	bool	poll(unsigned ms);
+	virtual	int	available(void);
+};
+
 #endif
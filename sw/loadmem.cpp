@@ -6,6 +6,16 @@
 //
 // Purpose:	Load a local file into the SDRAM's memory
 //
+//	The file is mapped into memory, rather than read, and then streamed
+//	out across the bus WINDOW words at a time.  Since the bus doesn't wait
+//	for each write to be acknowledged before sending the next, this keeps
+//	the link busy for as long as the load takes, while we report how fast
+//	it is going.
+//
+//	A piece of the file may be loaded by giving an offset and a length.
+//	Should a load fail part way through, the offset to pick back up from
+//	is printed, so that the load may be resumed without starting over.
+//
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -44,22 +54,60 @@
 #include <ctype.h>
 #include <string.h>
 #include <signal.h>
-#include <assert.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "llcomms.h"
 #include "usbi.h"
 #include "port.h"
 #include "regdefs.h"
 
+// The number of words handed to the bus at a time.  Between each, we update
+// our progress report.
+#define	WINDOW	65536
+
 FPGA	*m_fpga;
 
+void	closeup(int v) {
+	m_fpga->kill();
+	exit(0);
+}
+
+double	now(void) {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void	usage(void) {
+	printf("USAGE: loadmem [-u] [-p[port]] [-b base] [-o offset] [-n length] srcfile\n"
+"\n"
+"\tLoads srcfile into the SDRAM, or wherever base points.\n"
+"\n"
+"\t-u\tConnect via the USB-JTAG port (the default)\n"
+"\t-p\tConnect via a network port, such as that of netusb.  The port\n"
+"\t\tnumber may follow, as in -p%d\n"
+"\t-b\tThe bus address to load the start of the file into.  This\n"
+"\t\tdefaults to the start of the SDRAM, 0x%08x.\n"
+"\t-o\tThe offset into the file to start loading from.  This part\n"
+"\t\tof the file still goes to base+offset, so a failed load may be\n"
+"\t\tresumed by rerunning it with the offset it reports.\n"
+"\t-n\tThe number of bytes to load, from offset on.  By default, the\n"
+"\t\trest of the file is loaded.\n",
+		FPGAPORT, SDRAMBASE);
+}
+
 int main(int argc, char **argv) {
-	FILE		*fpin;
-	unsigned	pos=0;
-	int		port = FPGAPORT, skp;
-	const int	BUFLN = 127;
-	FPGA::BUSW	*buf = new FPGA::BUSW[BUFLN];
-	bool		use_usb = true;
+	int		fd, port = FPGAPORT, skp;
+	unsigned	base = SDRAMBASE, offset = 0, len = 0, pos = 0;
+	bool		use_usb = true, len_given = false;
+	struct stat	sb;
+	const char	*data;
+	double		start, dt;
+	const unsigned	MAXRAM = SDRAMBASE*2;
 
 	skp = 1;
 	for(int argn=0; argn<argc-skp; argn++) {
@@ -70,54 +118,144 @@ int main(int argc, char **argv) {
 				use_usb = false;
 				if (isdigit(argv[argn+skp][2]))
 					port = atoi(&argv[argn+skp][2]);
-			} skp++; argn--;
+			} else if ((argv[argn+skp][1] == 'b')
+					||(argv[argn+skp][1] == 'o')
+					||(argv[argn+skp][1] == 'n')) {
+				unsigned	v;
+
+				if (argn+skp+1 >= argc) {
+					usage();
+					exit(EXIT_FAILURE);
+				}
+				v = strtoul(argv[argn+skp+1], NULL, 0);
+				if (argv[argn+skp][1] == 'b')
+					base = v;
+				else if (argv[argn+skp][1] == 'o')
+					offset = v;
+				else {
+					len = v;
+					len_given = true;
+				}
+				skp++; argn--;
+			} else {
+				usage();
+				exit(EXIT_SUCCESS);
+			}
+			skp++; argn--;
 		} else
 			argv[argn] = argv[argn+skp];
 	} argc -= skp;
 
-	if (argc!=2) {
-		printf("Usage: loadmem [-p [port]] srcfile\n");
-		exit(-1);
+	if ((argc != 1)||(base & 3)||(offset & 3)||(len & 3)) {
+		usage();
+		exit(EXIT_FAILURE);
 	}
 
-	fpin = fopen(argv[0], "rb");
-	if (fpin == NULL) {
-		fprintf(stderr, "Could not open %s\n", argv[1]);
-		exit(-1);
+	fd = open(argv[0], O_RDONLY);
+	if ((fd < 0)||(fstat(fd, &sb) != 0)) {
+		fprintf(stderr, "Could not open %s\n", argv[0]);
+		exit(EXIT_FAILURE);
 	}
 
+	if (offset > (unsigned)sb.st_size) {
+		fprintf(stderr, "Offset 0x%08x is beyond the end of %s\n",
+			offset, argv[0]);
+		exit(EXIT_FAILURE);
+	} else if ((!len_given)||(offset + len > (unsigned)sb.st_size))
+		// Any partial word at the end of the file is dropped, just as
+		// it always has been
+		len = ((unsigned)sb.st_size - offset) & ~3u;
+
+	// Don't run off of the end of the SDRAM, if that's what we're loading
+	if ((base >= SDRAMBASE)&&(base < MAXRAM)
+			&&(base + offset + len > MAXRAM)) {
+		fprintf(stderr, "WARNING: %s is too long for the SDRAM, "
+			"only loading the first 0x%08x bytes\n", argv[0],
+			MAXRAM - base);
+		len = (offset >= MAXRAM - base) ? 0 : MAXRAM - base - offset;
+	}
+
+	if (len == 0) {
+		printf("Nothing to load\n");
+		close(fd);
+		exit(EXIT_SUCCESS);
+	}
+
+	data = (const char *)mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE,
+			fd, 0);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Could not map %s into memory\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	// We'll walk through the file once, from front to back
+	madvise((void *)data, sb.st_size, MADV_SEQUENTIAL);
+
 	if (use_usb)
 		m_fpga = new FPGA(new USBI());
 	else
 		m_fpga = new FPGA(new NETCOMMS(FPGAHOST, port));
 
+	signal(SIGSTOP, closeup);
+	signal(SIGHUP, closeup);
 
+	start = now();
 	try {
-		int	nr;
-		pos = SDRAMBASE;
-		do {
-			nr = BUFLN;
-			if (nr + pos > SDRAMBASE*2)
-				nr = SDRAMBASE*2 - pos;
-			nr = fread(buf, sizeof(FPGA::BUSW), nr, fpin);
-			if (nr <= 0)
-				break;
-
-			m_fpga->writei(pos, nr, buf);
-			pos += nr;
-		} while((nr > 0)&&(pos < 2*SDRAMBASE));
-
-		printf("SUCCESS::fully wrote full file to memory (pos = %08x)\n", pos);
+		for(pos = offset; pos < offset + len; ) {
+			unsigned	nw = (offset + len - pos)>>2;
+
+			if (nw > WINDOW)
+				nw = WINDOW;
+			m_fpga->writei(base + pos, nw,
+				(const FPGA::BUSW *)&data[pos]);
+			pos += nw<<2;
+
+			dt = now() - start;
+			printf("\r0x%08x: %5.1f%%, %7.3f MB/s", base+pos,
+				100.0 * (pos - offset) / len,
+				(dt > 0.0) ? (pos - offset) / dt / 1e6 : 0.0);
+			fflush(stdout);
+		}
+
+		// The last writes may not have been acknowledged yet.  Reading
+		// something back waits for them, and for any errors they might
+		// have run into.
+		m_fpga->readio(R_VERSION);
+		dt = now() - start;
+
+		printf("\nSUCCESS::wrote 0x%08x bytes to 0x%08x-0x%08x in %.2f s, "
+			"%.3f MB/s\n", len, base+offset, base+offset+len-1,
+			dt, len / dt / 1e6);
 	} catch(BUSERR a) {
-		fprintf(stderr, "BUS Err while writing at address 0x%08x\n", a.addr);
+		unsigned	resume = pos;
+
+		// Acknowledgements, and the errors that come with them, may
+		// arrive well after their writes were sent, and needn't say
+		// where they came from.  Resume from wherever the failure was,
+		// if we know it, or else from the start of the last window,
+		// since everything before that has been acknowledged.
+		if ((a.addr >= base + offset)&&(a.addr < base + pos))
+			resume = a.addr - base;
+		else if (pos > offset + (WINDOW<<2))
+			resume = pos - (WINDOW<<2);
+		else
+			resume = offset;
+
+		if (a.addr != 0)
+			fprintf(stderr, "\nBUS Err while writing at address 0x%08x\n",
+				a.addr);
+		else
+			fprintf(stderr, "\nBUS Err while writing\n");
 		fprintf(stderr, "... is your program too long for this memory?\n");
+		fprintf(stderr, "To resume, use -o 0x%08x\n", resume);
 		exit(-2);
 	} catch(...) {
-		fprintf(stderr, "Other error\n");
+		fprintf(stderr, "\nOther error\n");
+		fprintf(stderr, "To resume, use -o 0x%08x\n",
+			(pos > offset + (WINDOW<<2)) ? pos - (WINDOW<<2) : offset);
 		exit(-3);
 	}
 
-	fclose(fpin);
+	munmap((void *)data, sb.st_size);
+	close(fd);
 	delete	m_fpga;
 }
-
@@ -7,6 +7,25 @@
 // Purpose:	Forwards a XuLA2 board USB connection over a TCP socket, so
 //		a non-local computer can control the board.
 //
+//	Any number of clients (up to MAXCLIENTS) may be connected at once,
+//	and their requests may be freely interleaved.  Each client's TTYBUS
+//	keeps its own compression state (an address, a write table, and a
+//	read table), yet the FPGA has only one.  So we decode every codeword
+//	each client sends, using a copy of that client's state, and then
+//	re-encode it against the FPGA's state, which only we keep.  The
+//	responses are decoded the same way, and each is re-encoded against
+//	the state of the client it belongs to before being sent on.  As far
+//	as each client can tell, it has the FPGA all to itself.  Interrupts
+//	are sent to every client.
+//
+//	Clients may connect over TCP, through a Unix domain socket, or (one
+//	at a time) through shared memory.  The last two are only available
+//	to tools running on this same machine, but are both much quicker.
+//
+//	Traffic to and from each client is only printed if netusb is started
+//	with -v, since printing it all can easily take longer than the
+//	transfers themselves.
+//
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -45,16 +64,46 @@
 #include <fcntl.h>
 #include <termios.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <string.h>
-#include <poll.h>
 #include <signal.h>
 #include <ctype.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
 
 #include "port.h"
 #include "usbi.h"
+#include "shmlink.h"
+
+// The most clients we'll accept at once
+#define	MAXCLIENTS	16
+// How much we'll buffer from any one client, before we stop reading from it
+#define	CLIBUFLN	4096
+// How many codewords one client may send at once, before the next client
+// gets its turn
+#define	MAXBURST	64
+// The size of our buffer of codewords headed to the FPGA
+#define	TXBUFLN		8192
+// The number of response codewords we allow to be outstanding at once.  The
+// FPGA's return FIFO holds 1024 codewords, and has no way to tell us if it
+// overflows.
+#define	RSPWINDOW	(1024-8)
+#define	MAXQUEUE	1024
+// The sizes of the hash tables used to find values within the FPGA's write
+// table, and within each client's read table
+#define	LGWRHASH	10
+#define	LGRDHASH	10
+// The size of our copies of the read compression tables, as in ttybus.h
+#define	RDTBLLN		8192
+// How long to wait on a response that isn't coming before giving up on it,
+// such as the acknowledgement of a fill sent to an FPGA that doesn't know
+// how to fill
+#define	RSP_TIMEOUT_MS	2000
+// How often to make certain our shared memory client is still alive
+#define	SHM_REAP_MS	500
 
 void	sigstop(int v) {
 	fprintf(stderr, "SIGSTOP!!\n");
@@ -113,7 +162,7 @@ int	setup_listener(const int port) {
 		exit(-1);
 	}
 
-	if (listen(skt, 1) != 0) {
+	if (listen(skt, MAXCLIENTS) != 0) {
 		perror("Listen failed:");
 		exit(-1);
 	}
@@ -121,122 +170,1155 @@ int	setup_listener(const int port) {
 	return skt;
 }
 
-class	LINBUFS {
+int	setup_unix_listener(const char *path) {
+	int	skt;
+	struct	sockaddr_un	my_addr;
+
+	printf("Listening on %s\n", path);
+
+	skt = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (skt < 0) {
+		perror("Could not allocate socket: ");
+		exit(-1);
+	}
+
+	memset(&my_addr, 0, sizeof(my_addr));
+	my_addr.sun_family = AF_UNIX;
+	strncpy(my_addr.sun_path, path, sizeof(my_addr.sun_path)-1);
+
+	// Remove any socket left behind by a previous netusb
+	unlink(path);
+	if (bind(skt, (struct sockaddr *)&my_addr, sizeof(my_addr))!=0) {
+		perror("BIND FAILED:");
+		exit(-1);
+	}
+
+	if (listen(skt, MAXCLIENTS) != 0) {
+		perror("Listen failed:");
+		exit(-1);
+	}
+
+	return skt;
+}
+
+unsigned long	now_ms(void) {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
+// Decode one character of the six-bit bus encoding, or return -1 if it
+// isn't part of one
+int	sixbitdec(const char c) {
+	if ((c >= '0')&&(c <= '9'))
+		return c - '0';
+	else if ((c >= 'A')&&(c <= 'Z'))
+		return c - 'A' + 10;
+	else if ((c >= 'a')&&(c <= 'z'))
+		return c - 'a' + 36;
+	else if (c == '@')
+		return 0x3e;
+	else if (c == '%')
+		return 0x3f;
+	return -1;
+}
+
+// The inverse of the above
+char	sixbitenc(const int v) {
+	static	const	char	tbl[64+1] =
+	"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz@%";
+	return tbl[v&0x3f];
+}
+
+// The value of the n six-bit characters at cp, most significant first
+unsigned	cwval(const char *cp, const int n) {
+	unsigned	v = 0;
+
+	for(int i=0; i<n; i++)
+		v = (v<<6) | (sixbitdec(cp[i])&0x3f);
+	return v;
+}
+
+// The length, in characters, of a codeword sent to the FPGA, given its first
+// character.  This follows wbureadcw.v.
+int	cmdlen(const int sb) {
+	if (sb >= 0x30)		// Long read
+		return 2;
+	else if (sb >= 0x20)	// Short read
+		return 1;
+	else if (sb >= 0x18)	// Uncompressed write
+		return 6;
+	else if (sb >= 0x10)	// Write from the table
+		return 2;
+	else if (sb >= 0x08)	// Compressed address
+		return ((sb>>1)&3)+2;
+	return 6;		// Full address, or fill
+}
+
+// The length, in characters, of a codeword returned by the FPGA, given the
+// first n characters of it.  This follows TTYBUS::readword().  Delta
+// codewords need their second character before their length is known.
+int	rsplen(const char *cw, const int n) {
+	int	sb = sixbitdec(cw[0]);
+
+	if (sb < 0x08)		// Status, or a repeat of the last value
+		return 1;
+	else if (sb < 0x0c)	// Full address
+		return 6;
+	else if (sb < 0x10)	// Compressed address
+		return (sb&3)+2;
+	else if (sb < 0x20)	// Long table reference
+		return 2;
+	else if (sb < 0x30)	// Short table reference
+		return 1;
+	else if (sb < 0x34)	// Extended table reference
+		return 3;
+	else if (sb < 0x36)	// Option reply
+		return 1;
+	else if (sb < 0x38)	// Delta
+		return ((n >= 2)&&(sixbitdec(cw[1]) & 0x20)) ? 4 : 2;
+	return 6;		// Raw word
+}
+
+class	NETCLIENT {
 public:
-	char	m_iline[512], m_oline[512];
-	char	m_buf[256];
-	int	m_ilen, m_olen;
-	bool	m_connected;
+	// Our connection to this client.  This is either a socket, or else
+	// (if m_fd < 0) the shared memory link.
+	int		m_fd;
+	SHMLINK		*m_shm;
+	// A number unique to this connection, so that responses owed to a
+	// client that has since gone away don't go to whoever takes its slot
+	unsigned	m_uid;
+	// Characters received from this client, not yet sent to the FPGA
+	char		m_ibuf[CLIBUFLN];
+	int		m_ilen;
+	// Characters from the FPGA, not yet sent to this client
+	char		m_obuf[RCV_BUFLEN];
+	int		m_olen;
+	// True if we've stopped reading from this client, because m_ibuf
+	// is full
+	bool		m_stalled;
+
+	// The compression state this client's TTYBUS believes the FPGA to
+	// have, as though it had the FPGA all to itself.  Addresses are word
+	// addresses, as they are on the wire.
+	unsigned	m_addr, m_lastwr;
+	unsigned	m_wrtbl[256];
+	int		m_wrpos;
+	// The values this client has been sent in full, and so may be
+	// referenced by its table, indexed as in TTYBUS::encode_write
+	unsigned	m_rdtbl[RDTBLLN];
+	unsigned long	m_rdseq, m_rdhash[1<<LGRDHASH], m_rdchain[RDTBLLN];
+	// True if this client has asked for references more than 521 back,
+	// and for delta codewords
+	bool		m_lghist, m_delta;
+	// The last word sent to this client, or zero following an address
+	unsigned	m_rdprev;
 
-	LINBUFS(void) {
-		m_ilen = 0; m_olen = 0; m_connected = false;
+	NETCLIENT(int fd, SHMLINK *shm, unsigned uid) : m_fd(fd), m_shm(shm),
+			m_uid(uid), m_ilen(0), m_olen(0), m_stalled(false) {
+		m_addr = m_lastwr = 0;
+		m_wrpos = 0;
+		for(int i=0; i<256; i++)
+			m_wrtbl[i] = 0;
+		m_rdseq = RDTBLLN;
+		for(int i=0; i<(1<<LGRDHASH); i++)
+			m_rdhash[i] = 0;
+		m_lghist = m_delta = false;
+		m_rdprev = 0;
 	}
 };
 
-bool	check_incoming(LINBUFS &lb, USBI *usbp, int confd, int timeout) {
-	struct	pollfd	p[2];
-	int	pv, nfds;
+// A response the FPGA owes to a client: either n acknowledgements, or the
+// n words remaining of a read
+typedef	struct	{
+	int		id;	// The client's slot
+	unsigned	uid;	// The client's uid, or zero if it's ours
+	bool		rd, started;
+	int		n, inc;
+	unsigned	addr;	// Where a read starts, as a word address
+} PENDING;
 
-	if (confd >= 0) {
-		// Only do this if we currently have a network connection
-		p[0].fd = confd;
-		p[0].events = POLLIN | POLLRDHUP | POLLERR;
-		nfds = 1;
+class	BUSLINK {
+	USBI		*m_usb;
+	int		m_epfd, m_skt, m_uskt;
+	NETCLIENT	*m_client[MAXCLIENTS];
+	// Our shared memory link, if we have one, and the slot and process
+	// ID of the client attached to it.  m_shmid is -1 if none is.
+	SHMLINK		*m_shm;
+	int		m_shmid;
+	pid_t		m_shmpid;
+	unsigned long	m_shm_checked;
+	unsigned	m_nextuid;
+	// Set following a bus error, until the FPGA has gone quiet.  After
+	// an error, we can't be certain how many responses remain.
+	bool		m_errhold;
+	unsigned long	m_last_rx;
+	// True if we are to print everything passing to and from our clients
+	bool		m_verbose;
 
-		if ((pv=poll(p, nfds, timeout)) < 0) {
-			perror("Poll Failed!  O/S Err:");
-			exit(-1);
+	// The FPGA's compression state, as we've left it.  Only we talk to
+	// the FPGA, so only we need to know this.
+	unsigned	m_addr, m_lastwr;
+	bool		m_addr_set, m_lastwr_set;
+	unsigned	m_wrtbl[256];
+	unsigned long	m_wrseq, m_wrhash[1<<LGWRHASH], m_wrchain[256];
+	unsigned	m_rdtbl[RDTBLLN];
+	int		m_rdpos;
+	// The last word the FPGA sent, or zero following an address
+	unsigned	m_rdprev;
+	// The options we've asked the FPGA for, one bit per option number.
+	// Since we decode everything it might send, we don't need to know
+	// whether or not they were granted.
+	unsigned	m_opts;
+
+	// Codewords waiting to be sent to the FPGA
+	char		m_txbuf[TXBUFLN];
+	int		m_txlen;
+	// The response codeword currently being received
+	char		m_rsp[8];
+	int		m_rsplen;
+
+	// Responses the FPGA still owes us, oldest first, and the number of
+	// response codewords they may take
+	PENDING		m_q[MAXQUEUE];
+	int		m_qhead, m_qlen, m_inflight;
+
+	void	add_client(int skt);
+	void	check_shm(void);
+	void	drop_client(int id);
+	void	client_read(int id);
+	void	send_client(int id);
+	void	stall(int id, bool stalled);
+
+	void	tx(const int sixbits) { m_txbuf[m_txlen++] = sixbitenc(sixbits); }
+	void	txaddr(const unsigned a);
+	void	txwrite(const unsigned v, const int inc);
+	void	flush_tx(void);
+	void	expect(int id, unsigned uid, bool rd, int n, int inc, unsigned a);
+	void	pop(void);
+	int	forward(int id);
+	bool	exec(int id, const char *cw, const int sb);
+	void	schedule(void);
+
+	int	owner(const PENDING &p) const {
+		return ((p.uid)&&(m_client[p.id])&&(m_client[p.id]->m_uid == p.uid))
+			? p.id : -1;
+	}
+	void	cli_put(int id, const char *s, int n);
+	void	cli_addr(int id, unsigned a);
+	void	cli_word(int id, unsigned v, int inc);
+	void	ack(void);
+	void	word(unsigned v);
+	void	error(const int sb);
+	void	abandon(void);
+	void	respond(const char *cw);
+	void	route(const char *buf, int len);
+
+public:
+	BUSLINK(USBI *usb, int skt, int uskt, SHMLINK *shm, bool verbose);
+	void	run(void);
+};
+
+BUSLINK::BUSLINK(USBI *usb, int skt, int uskt, SHMLINK *shm, bool verbose)
+		: m_usb(usb), m_skt(skt), m_uskt(uskt), m_shm(shm),
+		m_verbose(verbose) {
+	struct	epoll_event	ev;
+
+	for(int i=0; i<MAXCLIENTS; i++)
+		m_client[i] = NULL;
+	m_nextuid = 0;
+	m_shmid = -1;
+	m_shmpid = 0;
+	m_shm_checked = now_ms();
+	m_errhold = false;
+	m_last_rx = now_ms();
+
+	m_addr = m_lastwr = 0;
+	m_addr_set = m_lastwr_set = false;
+	m_wrseq = 256;
+	for(int i=0; i<(1<<LGWRHASH); i++)
+		m_wrhash[i] = 0;
+	for(int i=0; i<RDTBLLN; i++)
+		m_rdtbl[i] = 0;
+	m_rdpos = 0;
+	m_rdprev = 0;
+	m_opts = 0;
+
+	m_txlen = 0;
+	m_rsplen = 0;
+	m_qhead = m_qlen = m_inflight = 0;
+
+	m_epfd = epoll_create1(0);
+	if (m_epfd < 0) {
+		perror("EPOLL Create failed!  O/S Err:");
+		exit(-1);
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u32 = MAXCLIENTS;
+	if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_skt, &ev) != 0) {
+		perror("EPOLL Add failed!  O/S Err:");
+		exit(-1);
+	}
+	ev.data.u32 = MAXCLIENTS+1;
+	if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_uskt, &ev) != 0) {
+		perror("EPOLL Add failed!  O/S Err:");
+		exit(-1);
+	}
+}
+
+void	BUSLINK::add_client(int skt) {
+	struct	epoll_event	ev;
+	int	con, id;
+
+	con = accept(skt, 0, 0);
+	if (con < 0) {
+		perror("Accept failed!  O/S Err:");
+		return;
+	}
+
+	for(id=0; id<MAXCLIENTS; id++)
+		if (!m_client[id])
+			break;
+	if (id >= MAXCLIENTS) {
+		fprintf(stderr, "Too many clients, connection refused\n");
+		close(con);
+		return;
+	}
+
+	m_client[id] = new NETCLIENT(con, NULL, ++m_nextuid);
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.u32 = id;
+	if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, con, &ev) != 0) {
+		perror("EPOLL Add failed!  O/S Err:");
+		exit(-1);
+	}
+	printf("Client %d connected\n", id);
+}
+
+//
+// check_shm
+//
+// Notice when a client attaches to, or detaches from, our shared memory link.
+// A client that exits without detaching is noticed here as well, lest the
+// link remain in use until we restart.
+void	BUSLINK::check_shm(void) {
+	pid_t	pid;
+	int	id;
+
+	if (!m_shm)
+		return;
+
+	pid = __atomic_load_n(&m_shm->m_client, __ATOMIC_ACQUIRE);
+	if ((pid != 0)&&(now_ms() - m_shm_checked > SHM_REAP_MS)) {
+		m_shm_checked = now_ms();
+		if (shmlink_reap(m_shm)) {
+			printf("Shared memory client %d has gone away\n", pid);
+			pid = 0;
 		}
-		if (p[0].revents & POLLIN) {
-			/*
-			 else if (p[0].revents)
-			printf("UNKNOWN TTY EVENT: %d\n", p[0].revents);
-		*/
-			int nr = read(confd, lb.m_buf, 256);
-			if (nr == 0) {
-				lb.m_connected = false;
-				if (lb.m_olen > 0) {
-					lb.m_oline[lb.m_olen] = '\0';
-					printf("< %s\n", lb.m_oline);
-				} lb.m_olen = 0;
-				close(confd);
-			} else if (nr > 0) {
-				usbp->write(lb.m_buf, nr);
-			} for(int i=0; i<nr; i++) {
-				lb.m_oline[lb.m_olen++] = lb.m_buf[i];
-				assert(lb.m_buf[i] != '\0');
-				if ((lb.m_oline[lb.m_olen-1]=='\n')
-					||(lb.m_oline[lb.m_olen-1]=='\r')
-					||(lb.m_olen >= (int)sizeof(lb.m_oline)-1)) {
-					if (lb.m_olen >= (int)sizeof(lb.m_oline)-1)
-						lb.m_oline[lb.m_olen] = '\0';
-					else
-						lb.m_oline[lb.m_olen-1] = '\0';
-					if (lb.m_olen > 1)
-						printf("< %s\n", lb.m_oline);
-					lb.m_olen = 0;
-				}
-			}
-		} else if ((nfds>1)&&(p[1].revents)) {
-			printf("UNKNOWN SKT EVENT: %d\n", p[1].revents);
+	}
+
+	// A new client may have attached before we noticed the last leave
+	if ((m_shmid >= 0)&&(pid != m_shmpid))
+		drop_client(m_shmid);
+
+	if ((pid != 0)&&(m_shmid < 0)) {
+		for(id=0; id<MAXCLIENTS; id++)
+			if (!m_client[id])
+				break;
+		if (id >= MAXCLIENTS)
+			return;	// Try again once someone leaves
+
+		m_client[id] = new NETCLIENT(-1, m_shm, ++m_nextuid);
+		m_shmid = id;
+		m_shmpid = pid;
+		printf("Client %d connected, via shared memory\n", id);
+	}
+}
+
+// Close a client's connection.  If the FPGA still owes it responses, they
+// will be quietly discarded as they arrive.
+void	BUSLINK::drop_client(int id) {
+	NETCLIENT	*c = m_client[id];
+
+	printf("Client %d disconnected\n", id);
+	if (c->m_shm) {
+		pid_t	pid = m_shmpid;
+
+		// Throw away anything it left behind, so the next client
+		// starts afresh.  The client itself may already be gone, but
+		// if not, this lets it know it's been dropped.  Should
+		// another have taken its place already, leave that one be.
+		if (__atomic_load_n(&c->m_shm->m_client, __ATOMIC_ACQUIRE)
+				== pid)
+			c->m_shm->m_tofpga.drain();
+		__atomic_compare_exchange_n(&c->m_shm->m_client, &pid, 0,
+			false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+		m_shmid = -1;
+		m_shmpid = 0;
+	} else {
+		epoll_ctl(m_epfd, EPOLL_CTL_DEL, c->m_fd, NULL);
+		close(c->m_fd);
+	}
+	delete	c;
+	m_client[id] = NULL;
+}
+
+void	BUSLINK::stall(int id, bool stalled) {
+	NETCLIENT		*c = m_client[id];
+	struct	epoll_event	ev;
+
+	if (c->m_stalled == stalled)
+		return;
+	c->m_stalled = stalled;
+	if (c->m_shm)
+		return;
+	ev.events = (stalled) ? EPOLLRDHUP : (EPOLLIN | EPOLLRDHUP);
+	ev.data.u32 = id;
+	epoll_ctl(m_epfd, EPOLL_CTL_MOD, c->m_fd, &ev);
+}
+
+void	BUSLINK::client_read(int id) {
+	NETCLIENT	*c = m_client[id];
+	int		nr;
+
+	if (c->m_shm) {
+		nr = c->m_shm->m_tofpga.read(&c->m_ibuf[c->m_ilen],
+				CLIBUFLN-c->m_ilen);
+		if (nr == 0)
+			return;
+	} else
+		nr = read(c->m_fd, &c->m_ibuf[c->m_ilen], CLIBUFLN-c->m_ilen);
+	if (nr <= 0) {
+		if ((nr < 0)&&(errno == EINTR))
+			return;
+		drop_client(id);
+		return;
+	}
+
+	if (m_verbose)
+		printf("%d< %.*s\n", id,
+			(c->m_ibuf[c->m_ilen+nr-1]=='\n') ? nr-1 : nr,
+			&c->m_ibuf[c->m_ilen]);
+	c->m_ilen += nr;
+	if (c->m_ilen >= CLIBUFLN)
+		stall(id, true);
+}
+
+void	BUSLINK::send_client(int id) {
+	NETCLIENT	*c = m_client[id];
+	int		nw, pos = 0;
+
+	if (m_verbose)
+		printf("%d> %.*s\n", id, c->m_olen, c->m_obuf);
+	if (c->m_shm) {
+		unsigned long	start = now_ms();
+
+		while(pos < c->m_olen) {
+			pos += c->m_shm->m_fromfpga.write(&c->m_obuf[pos],
+					c->m_olen-pos);
+			if (pos >= c->m_olen)
+				break;
+			if ((__atomic_load_n(&c->m_shm->m_client,
+						__ATOMIC_ACQUIRE) != m_shmpid)
+				||(shmlink_reap(c->m_shm))
+				||(now_ms() - start > RSP_TIMEOUT_MS)) {
+				// It's either gone, or stopped listening
+				drop_client(id);
+				return;
+			} usleep(20);
 		}
+		c->m_olen = 0;
+		return;
 	}
 
-	if (usbp->poll(2)) {
-		int	nr, nrn;
-
-		nr = nrn = usbp->read(lb.m_buf,1,2);
-		while((nrn>0)&&(nr<255)&&((lb.m_buf[0]&0x80)==0)&&(lb.m_buf[0]>0x10)) {
-			nrn = usbp->read(&lb.m_buf[nr],1,2);
-			nr += nrn;
-		} if ((nr > 0)&&(confd >= 0)) {
-			// Return our result if we have a network
-			// connection
-			write(confd, lb.m_buf, nr);
-		} for(int i=0; i<nr; i++) {
-			lb.m_iline[lb.m_ilen++] = lb.m_buf[i];
-			if ((lb.m_iline[lb.m_ilen-1]=='\n')
-				||(lb.m_iline[lb.m_ilen-1]=='\r')
-				||(lb.m_ilen >= (int)sizeof(lb.m_iline)-1)) {
-				if (lb.m_ilen >= (int)sizeof(lb.m_iline)-1)
-					lb.m_iline[lb.m_ilen] = '\0';
-				else
-					lb.m_iline[lb.m_ilen-1] = '\0';
-				if (lb.m_ilen > 1)
-					printf("%c %s\n",
-						(confd>=0)?'>':'#', lb.m_iline);
-				lb.m_ilen = 0;
-			}
+	while(pos < c->m_olen) {
+		nw = send(c->m_fd, &c->m_obuf[pos], c->m_olen-pos,
+				MSG_NOSIGNAL);
+		if (nw <= 0) {
+			if ((nw < 0)&&(errno == EINTR))
+				continue;
+			drop_client(id);
+			return;
+		} pos += nw;
+	}
+	c->m_olen = 0;
+}
+
+//
+// txaddr
+//
+// Move the FPGA's address to the word address a, using the shortest
+// codeword that will do it.  This follows TTYBUS::encode_address.
+void	BUSLINK::txaddr(const unsigned a) {
+	int	diff = (int)(a - m_addr), n, rel = 0;
+	unsigned	v = a;
+
+	if ((m_addr_set)&&(a == m_addr))
+		return;
+
+	for(n=1; n<=4; n++) {
+		int	bits = 6*n;
+		if (a < (1u<<bits)) {
+			rel = 0; v = a;
+			break;
+		} else if ((m_addr_set)&&(diff >= -(1<<(bits-1)))
+				&&(diff < (1<<(bits-1)))) {
+			rel = 1; v = (unsigned)diff;
+			break;
+		}
+	}
+
+	if (n <= 4) {
+		tx(0x08 | ((n-1)<<1) | rel);
+		for(int k=n-1; k>=0; k--)
+			tx((v>>(6*k))&0x3f);
+	} else {
+		tx((a>>30)&0x03);
+		for(int k=4; k>=0; k--)
+			tx((a>>(6*k))&0x3f);
+	}
+
+	m_addr = a;
+	m_addr_set = true;
+}
+
+//
+// txwrite
+//
+// Write v to the FPGA's current address, from the FPGA's write table if
+// we can.  This follows TTYBUS::encode_write.
+void	BUSLINK::txwrite(const unsigned v, const int inc) {
+	unsigned	hash = (v * 0x9e3779b1u) >> (32-LGWRHASH);
+	int		caddr = 0;
+
+	for(unsigned long seq = m_wrhash[hash]; m_wrseq - seq < 256;
+			seq = m_wrchain[seq & 0x0ff]) {
+		if (m_wrtbl[seq & 0x0ff] == v) {
+			caddr = (int)(m_wrseq - seq);
+			break;
 		}
 	}
 
-	return (pv > 0);
+	if (caddr != 0) {
+		tx(0x10 | (((caddr>>6)&0x03)<<1) | (inc?1:0));
+		tx(caddr & 0x3f);
+	} else {
+		tx(0x18 | (((v>>30)&0x03)<<1) | (inc?1:0));
+		for(int k=4; k>=0; k--)
+			tx((v>>(6*k))&0x3f);
+
+		m_wrtbl[m_wrseq & 0x0ff] = v;
+		m_wrchain[m_wrseq & 0x0ff] = m_wrhash[hash];
+		m_wrhash[hash] = m_wrseq++;
+	}
+
+	if (inc)
+		m_addr++;
+	m_lastwr = v;
+	m_lastwr_set = true;
+}
+
+void	BUSLINK::flush_tx(void) {
+	if (m_txlen == 0)
+		return;
+	m_txbuf[m_txlen++] = '\n';
+	m_usb->write(m_txbuf, m_txlen);
+	m_txlen = 0;
+	m_last_rx = now_ms();
 }
 
-int	myaccept(int skt, int timeout) {
-	int	con = -1;
-	struct	pollfd	p[1];
-	int	pv;
+// Note that the FPGA will owe client id (uid) a response.  Reads count one
+// extra response codeword, for the address the FPGA may send first.
+void	BUSLINK::expect(int id, unsigned uid, bool rd, int n, int inc,
+		unsigned a) {
+	PENDING	*p;
 
-	p[0].fd = skt;
-	p[0].events = POLLIN | POLLERR;
-	if ((pv=poll(p, 1, timeout)) < 0) {
-		perror("Poll Failed!  O/S Err:");
-		exit(-1);
-	} if (p[0].revents & POLLIN) {
-		con = accept(skt, 0, 0);
-		if (con < 0) {
-			perror("Accept failed!  O/S Err:");
+	m_inflight += (rd) ? n+1 : n;
+	if (m_qlen > 0) {
+		p = &m_q[(m_qhead+m_qlen-1)%MAXQUEUE];
+		if ((!rd)&&(!p->rd)&&(p->uid == uid)&&(p->id == id)) {
+			p->n += n;
+			return;
+		}
+	}
+
+	assert(m_qlen < MAXQUEUE);
+	p = &m_q[(m_qhead+m_qlen)%MAXQUEUE];
+	p->id = id; p->uid = uid;
+	p->rd = rd; p->started = false;
+	p->n  = n;  p->inc = inc;
+	p->addr = a;
+	m_qlen++;
+}
+
+void	BUSLINK::pop(void) {
+	m_qhead = (m_qhead+1)%MAXQUEUE;
+	m_qlen--;
+}
+
+//
+// exec
+//
+// Act on one complete codeword from client id, as the FPGA would were it
+// this client's alone, re-encoding it against the FPGA's real state.
+// Returns false, having done nothing, if there's no room for the responses
+// it would need.
+bool	BUSLINK::exec(int id, const char *cw, const int sb) {
+	NETCLIENT	*c = m_client[id];
+	int		nrsp = 0, len = 0, n;
+	unsigned	v;
+
+	if ((sb >= 0x04)&&(sb < 0x20))	// Fills and writes
+		nrsp = 2;
+	else if (sb >= 0x20) {		// Reads
+		if (sb < 0x30)
+			len = ((sb>>1)&7)+1;
+		else
+			len = ((((sb>>1)&7)<<6) | sixbitdec(cw[1])) + 9;
+		nrsp = len+1;
+	}
+	if ((nrsp > 0)&&(m_inflight > 0)&&(m_inflight + nrsp > RSPWINDOW))
+		return false;
+
+	if (sb < 0x04) {		// Full address
+		c->m_addr = ((sb&3)<<30) | cwval(&cw[1], 5);
+	} else if ((sb < 0x08)&&(sixbitdec(cw[1]) != 0)) { // Option
+		int	opt = sixbitdec(cw[1]);
+		char	ch = sixbitenc(0x34);
+
+		// Every client has its own read table here, so we answer for
+		// ourselves.  Option 1 asks for the original history, 2 for
+		// the long history, and 3 for delta codewords.
+		if (opt == 1)
+			c->m_lghist = c->m_delta = false;
+		else if (opt == 2)
+			c->m_lghist = true;
+		else if (opt == 3)
+			c->m_delta = true;
+		cli_put(id, &ch, 1);
+
+		// The first time anyone asks, ask the FPGA too, so that the
+		// link to it may benefit
+		if ((opt >= 2)&&(opt <= 3)&&(!(m_opts & (1<<opt)))) {
+			tx(0x04); tx(opt);
+			for(int k=0; k<4; k++)
+				tx(0);
+			expect(id, 0, false, 1, 0, 0);
+			m_opts |= (1<<opt);
+		}
+	} else if (sb < 0x08) {		// Fill
+		unsigned	count = cwval(&cw[2], 4);
+
+		// The FPGA fills with the last value written.  If someone
+		// else has written since this client did, put it back.  The
+		// fill is about to overwrite this same word anyway.
+		if ((count > 0)&&((!m_lastwr_set)||(m_lastwr != c->m_lastwr))) {
+			txaddr(c->m_addr);
+			txwrite(c->m_lastwr, 0);
+			expect(id, 0, false, 1, 0, 0);
+		}
+
+		txaddr(c->m_addr);
+		tx(0x04 | (sb&1));
+		tx(0);
+		for(int k=3; k>=0; k--)
+			tx((count>>(6*k))&0x3f);
+		expect(id, c->m_uid, false, 1, 0, 0);
+		if (sb&1) {
+			c->m_addr += count;
+			m_addr += count;
+		}
+	} else if (sb < 0x10) {		// Compressed address
+		n = ((sb>>1)&3)+1;
+		v = cwval(&cw[1], n);
+		if (sb&1) {
+			int	sh = 32-6*n;
+			c->m_addr += (unsigned)(((int)(v<<sh))>>sh);
+		} else
+			c->m_addr = v;
+	} else if (sb < 0x20) {		// Write
+		if (sb < 0x18)
+			v = c->m_wrtbl[(c->m_wrpos
+				- ((((sb>>1)&3)<<6)|sixbitdec(cw[1])))&0x0ff];
+		else {
+			v = (((sb>>1)&3)<<30) | cwval(&cw[1], 5);
+			c->m_wrtbl[c->m_wrpos++] = v;
+			c->m_wrpos &= 0x0ff;
+		}
+
+		txaddr(c->m_addr);
+		txwrite(v, sb&1);
+		expect(id, c->m_uid, false, 1, 0, 0);
+		c->m_lastwr = v;
+		if (sb&1)
+			c->m_addr++;
+	} else {			// Read
+		txaddr(c->m_addr);
+		if (len <= 8)
+			tx(0x20 | ((len-1)<<1) | (sb&1));
+		else {
+			tx(0x30 | (((len-9)>>5)&0x0e) | (sb&1));
+			tx((len-9)&0x3f);
+		}
+		expect(id, c->m_uid, true, len, sb&1, c->m_addr);
+		if (sb&1) {
+			c->m_addr += len;
+			m_addr += len;
+		}
+	}
+
+	return true;
+}
+
+//
+// forward
+//
+// Pass up to MAXBURST codewords from client id on to the FPGA.  Returns the
+// number passed.
+int	BUSLINK::forward(int id) {
+	NETCLIENT	*c = m_client[id];
+	int		pos = 0, ncw = 0;
+
+	while((pos < c->m_ilen)&&(ncw < MAXBURST)) {
+		const char	*cw = &c->m_ibuf[pos];
+		int		sb = sixbitdec(cw[0]), n, k;
+
+		if (sb < 0) {
+			pos++;
+			continue;
+		}
+
+		// A newline, or anything else outside of our code, breaks off
+		// a codeword.  The FPGA would drop what came before it.
+		n = cmdlen(sb);
+		for(k=1; (k<n)&&(pos+k < c->m_ilen); k++)
+			if (sixbitdec(cw[k]) < 0)
+				break;
+		if (k < n) {
+			if (pos+k >= c->m_ilen)
+				break;	// Wait for the rest of it
+			pos += k;
+			continue;
+		}
+
+		if (m_txlen > TXBUFLN-32)
+			flush_tx();
+		if (!exec(id, cw, sb))
+			break;
+		pos += n;
+		ncw++;
+	}
+
+	c->m_ilen -= pos;
+	if (c->m_ilen > 0)
+		memmove(c->m_ibuf, &c->m_ibuf[pos], c->m_ilen);
+	if (c->m_ilen < CLIBUFLN)
+		stall(id, false);
+	return ncw;
+}
+
+//
+// schedule
+//
+// Pass whatever the clients have sent us on to the FPGA.  Clients take turns,
+// MAXBURST codewords apiece, for as long as any have anything to send and
+// there's room for the responses.
+void	BUSLINK::schedule(void) {
+	bool	busy;
+
+	if (m_errhold)
+		return;
+
+	do {
+		busy = false;
+		for(int id=0; id<MAXCLIENTS; id++)
+			if ((m_client[id])&&(forward(id) > 0))
+				busy = true;
+	} while(busy);
+
+	flush_tx();
+}
+
+void	BUSLINK::cli_put(int id, const char *s, int n) {
+	if (!m_client[id])
+		return;
+	if (m_client[id]->m_olen + n > RCV_BUFLEN) {
+		send_client(id);
+		if (!m_client[id])
+			return;
+	}
+
+	memcpy(&m_client[id]->m_obuf[m_client[id]->m_olen], s, n);
+	m_client[id]->m_olen += n;
+}
+
+// Tell a client where its read is starting from
+void	BUSLINK::cli_addr(int id, unsigned a) {
+	char	cw[6];
+
+	cw[0] = sixbitenc(0x08 | ((a>>30)&0x03));
+	for(int k=1; k<6; k++)
+		cw[k] = sixbitenc((a>>(6*(5-k)))&0x3f);
+	cli_put(id, cw, 6);
+	if (m_client[id])
+		m_client[id]->m_rdprev = 0;
+}
+
+//
+// cli_word
+//
+// Send a word that was read to a client, compressed against that client's
+// own read table.  This follows the decoding in TTYBUS::readword.
+void	BUSLINK::cli_word(int id, unsigned v, int inc) {
+	NETCLIENT	*c = m_client[id];
+	unsigned	hash = (v * 0x9e3779b1u) >> (32-LGRDHASH);
+	int		d = 0, dv;
+	unsigned	maxd, dx;
+	char		cw[6];
+
+	if (!c)
+		return;
+	dv = (int)(v - c->m_rdprev);
+	dx = v ^ c->m_rdprev;
+	c->m_rdprev = v;
+
+	maxd = (c->m_lghist) ? RDTBLLN-1 : 521;
+	for(unsigned long seq = c->m_rdhash[hash]; c->m_rdseq - seq <= maxd;
+			seq = c->m_rdchain[seq & (RDTBLLN-1)]) {
+		if (c->m_rdtbl[seq & (RDTBLLN-1)] == v) {
+			d = (int)(c->m_rdseq - seq);
+			break;
+		}
+	}
+
+	inc = (inc) ? 1:0;
+	if (d == 1) {
+		cw[0] = sixbitenc(0x06 | inc);
+		cli_put(id, cw, 1);
+	} else if ((d >= 2)&&(d < 10)) {
+		cw[0] = sixbitenc(0x20 | ((d-2)<<1) | inc);
+		cli_put(id, cw, 1);
+	} else if ((d >= 10)&&(d < 522)) {
+		cw[0] = sixbitenc(0x10 | (((d-10)>>5)&0x0e) | inc);
+		cw[1] = sixbitenc((d-10)&0x3f);
+		cli_put(id, cw, 2);
+	} else {
+		// Take whichever is shortest, as wbucompress.v would
+		if ((c->m_delta)&&(dv >= -16)&&(dv < 16)) {
+			cw[0] = sixbitenc(0x36 | inc);
+			cw[1] = sixbitenc(dv & 0x1f);
+			cli_put(id, cw, 2);
+		} else if (d >= 522) {
+			cw[0] = sixbitenc(0x30 | (((d-522)>>11)&0x02) | inc);
+			cw[1] = sixbitenc(((d-522)>>6)&0x3f);
+			cw[2] = sixbitenc((d-522)&0x3f);
+			cli_put(id, cw, 3);
+		} else if ((c->m_delta)&&(((dv >= -32768)&&(dv < 32768))
+				||(dx < 0x10000))) {
+			if ((dv >= -32768)&&(dv < 32768))
+				dx = 0x20000 | (dv & 0x0ffff);
+			else
+				dx |= 0x30000;
+			cw[0] = sixbitenc(0x36 | inc);
+			for(int k=1; k<4; k++)
+				cw[k] = sixbitenc((dx>>(6*(3-k)))&0x3f);
+			cli_put(id, cw, 4);
+		} else {
+			cw[0] = sixbitenc(0x38 | ((v>>29)&0x06) | inc);
+			for(int k=1; k<6; k++)
+				cw[k] = sixbitenc((v>>(6*(5-k)))&0x3f);
+			cli_put(id, cw, 6);
+		}
+
+		// Raw words, deltas, and those from far enough back, are
+		// (re)added to the client's table
+		c->m_rdtbl[c->m_rdseq & (RDTBLLN-1)] = v;
+		c->m_rdchain[c->m_rdseq & (RDTBLLN-1)] = c->m_rdhash[hash];
+		c->m_rdhash[hash] = c->m_rdseq++;
+	}
+}
+
+void	BUSLINK::ack(void) {
+	PENDING	*p = &m_q[m_qhead];
+	int	id;
+
+	if ((m_qlen == 0)||(p->rd)) {
+		fprintf(stderr, "Unexpected acknowledgement\n");
+		return;
+	}
+
+	if ((id = owner(*p)) >= 0)
+		cli_put(id, "2", 1);
+	m_inflight--;
+	if (--p->n == 0)
+		pop();
+}
+
+void	BUSLINK::word(unsigned v) {
+	PENDING	*p = &m_q[m_qhead];
+	int	id;
+
+	// An older FPGA doesn't acknowledge fills.  If we're still waiting
+	// on an acknowledgement when a word arrives, it isn't coming.
+	while((m_qlen > 0)&&(!p->rd)) {
+		m_inflight -= p->n;
+		pop();
+		p = &m_q[m_qhead];
+	}
+
+	if (m_qlen == 0) {
+		fprintf(stderr, "Unexpected word, %08x\n", v);
+		return;
+	}
+
+	if ((id = owner(*p)) >= 0) {
+		if (!p->started)
+			cli_addr(id, p->addr);
+		cli_word(id, v, p->inc);
+	}
+	p->started = true;
+	m_inflight--;
+	if (--p->n == 0) {
+		m_inflight--;
+		pop();
+	}
+}
+
+// The FPGA has reported a bus error, or a reset, in place of whatever it
+// was going to send next
+void	BUSLINK::error(const int sb) {
+	char	ch = sixbitenc(sb);
+
+	if (m_qlen > 0) {
+		PENDING	*p = &m_q[m_qhead];
+		int	id;
+
+		if ((id = owner(*p)) >= 0)
+			cli_put(id, &ch, 1);
+		m_inflight -= (p->rd) ? p->n+1 : p->n;
+		pop();
+	} else for(int id=0; id<MAXCLIENTS; id++)
+		cli_put(id, &ch, 1);
+
+	m_addr_set = false;
+	m_lastwr_set = false;
+	m_errhold = true;
+	// A reset returns the FPGA to its original compression history
+	if (sb == 3)
+		m_opts = 0;
+}
+
+// Give up on any responses still owed.  Any client waiting on a read is
+// told it suffered a bus error, rather than being left to wait forever.
+void	BUSLINK::abandon(void) {
+	bool	told[MAXCLIENTS];
+
+	for(int id=0; id<MAXCLIENTS; id++)
+		told[id] = false;
+	while(m_qlen > 0) {
+		int	id = owner(m_q[m_qhead]);
+		if ((id >= 0)&&(m_q[m_qhead].rd)&&(!told[id])) {
+			cli_put(id, "5", 1);
+			told[id] = true;
+		} pop();
+	}
+
+	m_inflight = 0;
+	m_addr_set = false;
+	m_lastwr_set = false;
+	for(int id=0; id<MAXCLIENTS; id++)
+		if ((m_client[id])&&(m_client[id]->m_olen > 0))
+			send_client(id);
+}
+
+//
+// respond
+//
+// Act on one complete response codeword from the FPGA.  This follows the
+// decoding in TTYBUS::readword.
+void	BUSLINK::respond(const char *cw) {
+	int		sb = sixbitdec(cw[0]), idx;
+	unsigned	v;
+
+	if (sb < 2)		// Idle
+		return;
+	else if (sb == 2)	// Write acknowledgement
+		ack();
+	else if (sb == 4) {	// Interrupt, everyone gets one
+		for(int id=0; id<MAXCLIENTS; id++)
+			cli_put(id, "4", 1);
+	} else if ((sb == 3)||(sb == 5))
+		error(sb);
+	else if ((sb >= 0x08)&&(sb < 0x10)) {
+		// An address.  We know where we are, and our clients are
+		// told where their reads start.
+		m_rdprev = 0;
+	} else if ((sb >= 0x34)&&(sb < 0x36)) {
+		// The FPGA has answered our option, in place of the
+		// acknowledgement an older one would give
+		ack();
+	} else {
+		if (sb < 0x08)		// Repeat the last value
+			v = m_rdtbl[(m_rdpos-1)&(RDTBLLN-1)];
+		else if (sb < 0x20) {	// Table, up to 521 back
+			idx = ((((sb>>1)&7)<<6) | sixbitdec(cw[1])) + 10;
+			v = m_rdtbl[(m_rdpos-idx)&(RDTBLLN-1)];
+		} else if (sb < 0x30) {	// Table, 2-9 back
+			idx = ((sb>>1)&7) + 2;
+			v = m_rdtbl[(m_rdpos-idx)&(RDTBLLN-1)];
+		} else if (sb < 0x34) {	// Table, 522 or more back
+			idx = (((sb>>1)&1)<<12) + cwval(&cw[1], 2) + 522;
+			v = m_rdtbl[(m_rdpos-idx)&(RDTBLLN-1)];
+			m_rdtbl[m_rdpos++] = v;
+			m_rdpos &= (RDTBLLN-1);
+		} else if (sb < 0x38) {	// Delta from the last word
+			int	c1 = sixbitdec(cw[1]);
+			if (c1 & 0x20) {
+				unsigned d = ((c1&0x0f)<<12) | cwval(&cw[2], 2);
+				v = (c1 & 0x10) ? (m_rdprev ^ d)
+					: m_rdprev + (unsigned)(((int)(d<<16))>>16);
+			} else
+				v = m_rdprev + (unsigned)(((int)(c1<<27))>>27);
+			m_rdtbl[m_rdpos++] = v;
+			m_rdpos &= (RDTBLLN-1);
+		} else {		// Raw word
+			v = (((sb>>1)&3)<<30) | cwval(&cw[1], 5);
+			m_rdtbl[m_rdpos++] = v;
+			m_rdpos &= (RDTBLLN-1);
+		}
+
+		m_rdprev = v;
+		word(v);
+	}
+}
+
+//
+// route
+//
+// Decode the characters returned from the FPGA, and send each response on to
+// whomever it belongs to.
+void	BUSLINK::route(const char *buf, int len) {
+	for(int i=0; i<len; i++) {
+		if (sixbitdec(buf[i]) < 0)
+			continue;
+
+		m_rsp[m_rsplen++] = buf[i];
+		if (m_rsplen >= rsplen(m_rsp, m_rsplen)) {
+			respond(m_rsp);
+			m_rsplen = 0;
+		}
+	}
+
+	for(int id=0; id<MAXCLIENTS; id++)
+		if ((m_client[id])&&(m_client[id]->m_olen > 0))
+			send_client(id);
+}
+
+void	BUSLINK::run(void) {
+	struct	epoll_event	ev[MAXCLIENTS+2];
+	char	buf[RCV_BUFLEN];
+
+	// Flush anything left within the USB device from before
+	while(m_usb->poll(4)) {
+		int	avail = m_usb->available();
+
+		if (avail > (int)sizeof(buf))
+			avail = sizeof(buf);
+		m_usb->read(buf, avail);
+	}
+
+	while(1) {
+		int	nev, timeout;
+
+		// Don't wait on the network if the FPGA has something for us,
+		// or if we need to keep an eye on our shared memory
+		timeout = ((m_qlen > 0)||(m_errhold)||(m_shm)) ? 0 : 10;
+		nev = epoll_wait(m_epfd, ev, MAXCLIENTS+2, timeout);
+		if ((nev < 0)&&(errno != EINTR)) {
+			perror("EPOLL Wait failed!  O/S Err:");
 			exit(-1);
 		}
-	} return con;
+
+		for(int i=0; i<nev; i++) {
+			unsigned id = ev[i].data.u32;
+			if (id == MAXCLIENTS)
+				add_client(m_skt);
+			else if (id == MAXCLIENTS+1)
+				add_client(m_uskt);
+			else if (!m_client[id])
+				continue;
+			else if (ev[i].events & EPOLLIN)
+				client_read(id);
+			else if (ev[i].events & (EPOLLRDHUP|EPOLLHUP|EPOLLERR))
+				drop_client(id);
+		}
+
+		check_shm();
+		if ((m_shmid >= 0)&&(!m_client[m_shmid]->m_stalled))
+			client_read(m_shmid);
+
+		schedule();
+
+		// Then check the FPGA for anything it may have said
+		if (m_usb->poll(2)) {
+			int	nr, avail = m_usb->available();
+
+			if (avail > (int)sizeof(buf))
+				avail = sizeof(buf);
+			nr = m_usb->read(buf, avail);
+			if (nr > 0) {
+				m_last_rx = now_ms();
+				route(buf, nr);
+			}
+		} else if (m_errhold) {
+			// The FPGA has gone quiet following an error
+			abandon();
+			m_errhold = false;
+		} else if ((m_qlen > 0)
+				&&(now_ms() - m_last_rx > RSP_TIMEOUT_MS)) {
+			fprintf(stderr, "Gave up waiting on %d responses\n",
+				m_inflight);
+			abandon();
+		}
+
+		schedule();
+	}
+}
+
+void	usage(void) {
+	printf("USAGE: netusb [-v]\n"
+"\n"
+"\tForwards the XuLA2 board's USB connection to TCP port %d, to the\n"
+"\tUnix domain socket %s, and to the shared memory link %s\n"
+"\n"
+"\t-v\tPrint everything sent to or received from every client\n",
+		FPGAPORT, FPGAUNIX, FPGASHM);
 }
 
 int	main(int argc, char **argv) {
-	// First, accept a network connection
-	int	skt = setup_listener(FPGAPORT);
+	int	skt, uskt;
+	SHMLINK	*shm;
+	bool	verbose = false;
 	USBI	*usbp;
-	bool	done = false;
+	BUSLINK	*link;
+
+	for(int argn=1; argn<argc; argn++) {
+		if (strcmp(argv[argn], "-v")==0)
+			verbose = true;
+		else {
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	skt  = setup_listener(FPGAPORT);
+	uskt = setup_unix_listener(FPGAUNIX);
+	shm  = shmlink_create(FPGASHM);
+	if (!shm)
+		fprintf(stderr, "Continuing without shared memory\n");
 
 	signal(SIGSTOP, sigstop);
 	signal(SIGBUS, sigbus);
@@ -246,39 +1328,12 @@ int	main(int argc, char **argv) {
 	signal(SIGHUP, sighup);
 
 	usbp = new USBI();
-
-	LINBUFS	lb;
-	while(!done) {
-		int	con;
-
-		// Accept a connection before going on
-		// Let's call poll(), so we can still read any
-		// tty messages even when not accepted
-		con = myaccept(skt, 50);
-		if (con >= 0) {
-			lb.m_connected = true;
-
-			/*
-			// Set our new socket as non-blocking
-			int flags = fcntl(fd, F_GETFL, 0);
-			flags |= O_NONBLOCK;
-			fcntl(fd, F_SETFL, flags);
-			*/
-
-			// printf("Received a new connection\n");
-		}
-
-		// Flush any buffer within the TTY
-		while(check_incoming(lb, usbp, -1, 0))
-			;
-
-		// Now, process that connection until it's gone
-		while(lb.m_connected) {
-			check_incoming(lb, usbp, con, -1);
-		}
-	}
+	link = new BUSLINK(usbp, skt, uskt, shm, verbose);
+	link->run();
 
 	printf("Closing our socket\n");
 	close(skt);
+	close(uskt);
+	unlink(FPGAUNIX);
+	shm_unlink(FPGASHM);
 }
-
@@ -46,8 +46,22 @@
 #define	FPGATTY		"/dev/ttyUSB1"
 #define	FPGAPORT	7239	// Just some random port number ....
 
-#ifdef	USBI_H
+// When the tools run on the same machine as netusb or the simulation, either
+// of these may be used in place of the TCP port above, as they're both much
+// quicker.  netusb and busmaster_tb offer all three.
+#define	FPGAUNIX	"/tmp/xulalx25soc.sock"	// A Unix domain socket
+#define	FPGASHM		"/xulalx25soc"		// A shared memory link
+
+// Define one of these to have FPGAOPEN connect locally
+// #define	FPGA_USE_UNIX
+// #define	FPGA_USE_SHM
+
+#if	defined(USBI_H)
 #define	FPGAOPEN(V) V= new FPGA(new USBI())
+#elif	defined(FPGA_USE_UNIX)
+#define	FPGAOPEN(V) V= new FPGA(new UNIXCOMMS(FPGAUNIX))
+#elif	defined(FPGA_USE_SHM)
+#define	FPGAOPEN(V) V= new FPGA(new SHMCOMMS(FPGASHM))
 #else
 #define FPGAOPEN(V) V= new FPGA(new NETCOMMS(FPGAHOST, FPGAPORT))
 #endif
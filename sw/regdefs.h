@@ -187,6 +187,16 @@
 #define	CPU_uSP		(0x001d|CPU_HALT)
 #define	CPU_uCC		(0x001e|CPU_HALT)
 #define	CPU_uPC		(0x001f|CPU_HALT)
+// The ZipSystem's DMA controller, as seen from R_ZIPDATA.  (The CPU is
+// halted while we access it.)
+#define	CPU_DMACTRL	(0x0030|CPU_HALT)
+#define	CPU_DMALEN	(0x0031|CPU_HALT)
+#define	CPU_DMASRC	(0x0032|CPU_HALT)
+#define	CPU_DMADST	(0x0033|CPU_HALT)
+#define	CPU_DMACRC	(0x0034|CPU_HALT)
+#define	DMA_BUSY	0x80000000
+#define	DMA_ERR		0x40000000
+#define	DMA_START	0x0fed0000	// Increment both, 1kW blocks
 
 // Scop definition/sequences
 #define	SCOPE_NO_RESET	0x80000000
@@ -107,12 +107,12 @@ int	SCOPE::scoplen(void) {
 }
 
 //
-// rawread
+// start_read
 //
-// Read the scope data from the scope.
-void	SCOPE::rawread(void) {
-	// If we've already read the data from the scope, then we don't need
-	// to read it a second time.
+// Start reading the scope data from the scope.
+void	SCOPE::start_read(void) {
+	// If we've already read the data from the scope, or started to, then
+	// we don't need to read it a second time.
 	if (m_data)
 		return;
 
@@ -135,14 +135,29 @@ void	SCOPE::rawread(void) {
 	// If the bus works, you'll want to use readz(): read scoplen values
 	// into the buffer, from the address WBSCOPEDATA, without incrementing
 	// the address each time (hence the 'z' in readz--for zero increment).
+	// Here, we only submit that read.  rawread() will wait for it.
 	if (m_vector_read) {
-		m_fpga->readz(m_addr+4, m_scoplen, m_data);
+		m_rdhandle = m_fpga->submit_readz(m_addr+4, m_scoplen, m_data);
+		m_rdpending = true;
 	} else {
 		for(unsigned int i=0; i<m_scoplen; i++)
 			m_data[i] = m_fpga->readio(m_addr+4);
 	}
 }
 
+//
+// rawread
+//
+// Read the scope data from the scope.
+void	SCOPE::rawread(void) {
+	start_read();
+
+	if (m_rdpending) {
+		m_rdpending = false;
+		m_fpga->wait_read(m_rdhandle);
+	}
+}
+
 void	SCOPE::print(void) {
 	unsigned long addrv = 0, alen;
 	int	offset;
@@ -291,6 +306,10 @@ void	SCOPE::register_trace(const char *name,
  * is a touch longer.
  */
 unsigned	SCOPE::getaddresslen(void) {
+	// Wait for any read of the data that's still on its way
+	if (m_rdpending)
+		rawread();
+
 	// Find the offset to the trigger
 	if (m_compressed) {
 		// First, find the overall length
@@ -320,7 +339,7 @@ void	SCOPE::writevcd(FILE *fp) {
 	unsigned	alen;
 	int	offset = 0;
 
-	if (!m_data)
+	if ((!m_data)||(m_rdpending))
 		rawread();
 
 	// If the traces haven't yet been defined, then define them now.
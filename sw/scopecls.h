@@ -88,6 +88,8 @@ class	SCOPE {
 	unsigned	m_scoplen,	// Number of words in the scopes memory
 			m_holdoff;	// The bias, or samples since trigger
 	unsigned	*m_data;	// Data read from the scope
+	bool		m_rdpending;	// True if m_data is still on its way
+	int		m_rdhandle;	// DEVBUS handle for reading m_data
 	unsigned	m_clkfreq_hz;
 
 	// The m_traces variable holds a list of all of the various wire
@@ -99,7 +101,7 @@ public:
 			bool compressed=false, bool vecread=true)
 		: m_fpga(fpga), m_addr(addr),
 			m_compressed(compressed), m_vector_read(vecread),
-			m_scoplen(0), m_data(NULL) {
+			m_scoplen(0), m_data(NULL), m_rdpending(false) {
 		//
 		// First thing we want to do upon allocating a scope, is to
 		// define the traces for that scope.  Sad thing is ... we can't
@@ -116,6 +118,7 @@ public:
 	~SCOPE(void) {
 		for(unsigned i=0; i<m_traces.size(); i++)
 			delete m_traces[i];
+		if (m_rdpending) m_fpga->wait_read(m_rdhandle);
 		if (m_data) delete[] m_data;
 	}
 
@@ -139,6 +142,13 @@ public:
 	// Read any previously set clock speed.
 	unsigned get_clkfreq_hz(void) { return m_clkfreq_hz; }
 
+	// Start reading the data from the scope into our m_data array, but
+	// don't wait for it to arrive.  This allows the reads from several
+	// scopes to be in flight at once, or other work to take place in the
+	// meantime.  rawread() will then wait for the data, as will anything
+	// else here that looks at it.
+		void	start_read(void);
+
 	// Read the data from the scope and place it into our m_data array.
 	// Nothing more is done with it beyond that.
 	virtual	void	rawread(void);
@@ -220,6 +230,8 @@ public:
 				unsigned nbits, unsigned shift);
 
 	unsigned operator[](unsigned addr) {
+		if (m_rdpending)
+			rawread();
 		if ((m_data)&&(m_scoplen > 0))
 			return m_data[(addr)&(m_scoplen-1)];
 		return 0;
@@ -0,0 +1,181 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	shmlink.h
+//
+// Project:	XuLA2-LX25 SoC based upon the ZipCPU
+//
+// Purpose:	A bus connection through POSIX shared memory, for when the
+//		tools run on the same machine as netusb or the busmaster_tb
+//	simulation.  The link is a pair of byte rings (see spscring.h), one
+//	headed towards the FPGA and one coming back from it.  Neither side
+//	makes a system call to pass data, so a round trip costs only as much
+//	as the two sides take to notice.
+//
+//	The server (netusb, or PIPECMDR) creates the link, and a client
+//	(SHMCOMMS) attaches to it.  Only one client may be attached at a
+//	time.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015-2017, Gisselquist Technology, LLC
+//
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of  the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+//
+// License:	GPL, v3, as defined and found on www.gnu.org,
+//		http://www.gnu.org/licenses/gpl.html
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	SHMLINK_H
+#define	SHMLINK_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "spscring.h"
+
+// The size of each ring, in bytes.  This must be a power of two.
+#define	SHMRINGLN	65536
+#define	SHMMAGIC	0x78756c61	// "xula"
+
+typedef	SPSCRING<SHMRINGLN>	SHMRING;
+
+typedef	struct	SHMLINK_S {
+	unsigned	m_magic;
+	// The process ID of the server, so a client can tell if it's gone
+	pid_t		m_server;
+	// The process ID of the client attached, or zero if there isn't one
+	volatile pid_t	m_client;
+	SHMRING		m_tofpga, m_fromfpga;
+} SHMLINK;
+
+//
+// shmlink_create
+//
+// Create the shared memory link called name, for a server.  Returns NULL
+// on any failure.
+static inline	SHMLINK	*shmlink_create(const char *name) {
+	SHMLINK	*lnk;
+	int	fd;
+
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		perror("SHM Open failed:");
+		return NULL;
+	}
+
+	if (ftruncate(fd, sizeof(SHMLINK)) != 0) {
+		perror("SHM Truncate failed:");
+		::close(fd);
+		return NULL;
+	}
+
+	lnk = (SHMLINK *)mmap(NULL, sizeof(SHMLINK), PROT_READ|PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	::close(fd);
+	if (lnk == MAP_FAILED) {
+		perror("SHM Map failed:");
+		return NULL;
+	}
+
+	lnk->m_tofpga.reset();
+	lnk->m_fromfpga.reset();
+	lnk->m_client = 0;
+	lnk->m_server = getpid();
+	__atomic_store_n(&lnk->m_magic, SHMMAGIC, __ATOMIC_RELEASE);
+	return lnk;
+}
+
+//
+// shmlink_attach
+//
+// Attach to the shared memory link called name, as its client.  Returns
+// NULL if there is no such link, or if it already has a client.
+static inline	SHMLINK	*shmlink_attach(const char *name) {
+	SHMLINK		*lnk;
+	pid_t		idle = 0;
+	int		fd;
+
+	fd = shm_open(name, O_RDWR, 0600);
+	if (fd < 0) {
+		perror("SHM Open failed:");
+		return NULL;
+	}
+
+	lnk = (SHMLINK *)mmap(NULL, sizeof(SHMLINK), PROT_READ|PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	::close(fd);
+	if (lnk == MAP_FAILED) {
+		perror("SHM Map failed:");
+		return NULL;
+	}
+
+	if ((__atomic_load_n(&lnk->m_magic, __ATOMIC_ACQUIRE) != SHMMAGIC)
+			||(kill(lnk->m_server, 0) != 0)) {
+		fprintf(stderr, "No server is attached to %s\n", name);
+		munmap(lnk, sizeof(SHMLINK));
+		return NULL;
+	}
+
+	if (!__atomic_compare_exchange_n(&lnk->m_client, &idle, getpid(), false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		fprintf(stderr, "%s is already in use\n", name);
+		munmap(lnk, sizeof(SHMLINK));
+		return NULL;
+	}
+
+	// Anything left from a previous client isn't ours
+	lnk->m_fromfpga.drain();
+	return lnk;
+}
+
+//
+// shmlink_reap
+//
+// For the server: if the client attached to lnk has exited without ever
+// detaching, having crashed or been killed, free the link for the next
+// one.  Returns true if it did.  This costs a system call, so it's not
+// something to do on every pass through a loop.
+static inline	bool	shmlink_reap(SHMLINK *lnk) {
+	pid_t	pid = __atomic_load_n(&lnk->m_client, __ATOMIC_ACQUIRE);
+
+	if ((pid == 0)||(kill(pid, 0) == 0)||(errno != ESRCH))
+		return false;
+	return __atomic_compare_exchange_n(&lnk->m_client, &pid, 0, false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Let the server know we're done, and unmap the link
+static inline	void	shmlink_detach(SHMLINK *lnk) {
+	__atomic_store_n(&lnk->m_client, 0, __ATOMIC_RELEASE);
+	munmap(lnk, sizeof(SHMLINK));
+}
+
+#endif
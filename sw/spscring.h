@@ -0,0 +1,135 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	spscring.h
+//
+// Project:	XuLA2-LX25 SoC based upon the ZipCPU
+//
+// Purpose:	A lock-free byte ring, for passing data from exactly one
+//		producer to exactly one consumer.  The producer alone moves
+//	the head, the consumer alone moves the tail, and each only ever reads
+//	the other's index, so neither needs a lock.  The two may be threads
+//	(as within USBI, where libusb's completion thread fills the ring and
+//	the bus parser drains it) or processes (as within a shared memory
+//	link, see shmlink.h).
+//
+//	The ring has no constructor, so that it may be placed in shared
+//	memory.  Call reset() once before first using it.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015-2017, Gisselquist Technology, LLC
+//
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of  the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+//
+// License:	GPL, v3, as defined and found on www.gnu.org,
+//		http://www.gnu.org/licenses/gpl.html
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	SPSCRING_H
+#define	SPSCRING_H
+
+#include <string.h>
+
+#define	CACHELINE	64
+
+// LN is the size of the ring in bytes, and must be a power of two
+template <unsigned LN>	class	SPSCRING {
+	// The head and tail are free running counts of the bytes ever
+	// written and read.  They're padded out onto cache lines of their
+	// own, rather than aligned, so that this works no matter where it
+	// lands--on the heap, within another class, or in shared memory.
+	char			m_pad0[CACHELINE];
+	volatile unsigned	m_head;
+	char			m_pad1[CACHELINE-sizeof(unsigned)];
+	volatile unsigned	m_tail;
+	char			m_pad2[CACHELINE-sizeof(unsigned)];
+	char			m_buf[LN];
+
+	unsigned	head(void) const {
+		return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE); }
+	unsigned	tail(void) const {
+		return __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE); }
+
+public:
+	// Empty the ring.  Neither side may be using it at the time.
+	void	reset(void) { m_head = m_tail = 0; }
+
+	// The number of bytes waiting to be read.  Called by the consumer.
+	int	avail(void) const { return head() - m_tail; }
+
+	// The number of bytes that may be written.  Called by the producer.
+	int	room(void) const { return LN - (m_head - tail()); }
+
+	// Copy up to len bytes into the ring, returning the number copied.
+	// Called by the producer.
+	int	write(const char *buf, int len) {
+		unsigned	hd = m_head, pos, ln;
+		int		rm = room();
+
+		if (len > rm)
+			len = rm;
+		if (len <= 0)
+			return 0;
+
+		pos = hd & (LN-1);
+		ln  = (pos + len > LN) ? LN - pos : len;
+		memcpy(&m_buf[pos], buf, ln);
+		if ((int)ln < len)
+			memcpy(m_buf, &buf[ln], len-ln);
+
+		__atomic_store_n(&m_head, hd + len, __ATOMIC_RELEASE);
+		return len;
+	}
+
+	// Copy up to len bytes out of the ring, returning the number copied.
+	// Called by the consumer.
+	int	read(char *buf, int len) {
+		unsigned	tl = m_tail, pos, ln;
+		int		av = avail();
+
+		if (len > av)
+			len = av;
+		if (len <= 0)
+			return 0;
+
+		pos = tl & (LN-1);
+		ln  = (pos + len > LN) ? LN - pos : len;
+		memcpy(buf, &m_buf[pos], ln);
+		if ((int)ln < len)
+			memcpy(&buf[ln], m_buf, len-ln);
+
+		__atomic_store_n(&m_tail, tl + len, __ATOMIC_RELEASE);
+		return len;
+	}
+
+	// Look at the byte k places from the next to be read, without reading
+	// it.  k must be less than avail().  Called by the consumer.
+	char	peek(int k) const { return m_buf[(m_tail + k) & (LN-1)]; }
+
+	// Throw away anything waiting to be read.  Called by the consumer.
+	void	drain(void) {
+		__atomic_store_n(&m_tail, head(), __ATOMIC_RELEASE);
+	}
+};
+
+#endif
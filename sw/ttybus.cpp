@@ -57,8 +57,10 @@
 #include <strings.h> 
 #include <poll.h> 
 #include <ctype.h> 
+#include <time.h>
 
 #include "ttybus.h"
+#include "regdefs.h"
 
 #define	TTYC_IDLE	'0'
 #define	TTYC_BUSY	'1'
@@ -69,6 +71,26 @@
 
 const	unsigned TTYBUS::MAXRDLEN = 1024;
 const	unsigned TTYBUS::MAXWRLEN = 32;
+// Depth of the return FIFO within wbuoutput, 1<<LGOUTPUT_FIFO codewords.
+// Words requested but not yet read must fit in here, or the FPGA will
+// overflow it.
+const	unsigned TTYBUS::RDFIFOLEN = 1024;
+// READBLOCK is the most we'll ask for in any one read command.
+// RDWINDOW is the most we'll ever have requested but not yet read,
+// leaving some room in the return FIFO for address, idle, and
+// interrupt codewords that may be interleaved with our data.
+const	int	TTYBUS::READBLOCK = (MAXRDLEN/2>512)?512:MAXRDLEN/2;
+// The most words a single fill command may ask for
+const	unsigned TTYBUS::MAXFILLLEN = (1<<24)-1;
+const	int	TTYBUS::RDWINDOW  = ((MAXRDLEN<RDFIFOLEN)?MAXRDLEN:RDFIFOLEN)-8;
+// The most words we'll write before stopping to clear their acknowledgements
+// out of our way.  These are only one character each, and nothing is waiting
+// on them, so there's no reason to look after every line.
+const	unsigned TTYBUS::ACKWINDOW = 256;
+// The most writes we'll ever leave waiting on their acknowledgements.  Each
+// takes a codeword within the return FIFO, so this is the FIFO's depth, less
+// the same allowance for address, idle, and interrupt codewords as above.
+const	unsigned TTYBUS::WRCREDIT  = RDFIFOLEN-8;
 
 // #define	DBGPRINTF	printf
 // #define	DBGPRINTF	filedump
@@ -99,17 +121,28 @@ void	filedump(const char *fmt, ...) {
 	// va_end(args);
 }
 
+// The six-bit character set used by the bus, in code order
+static	const	char	sixbit_enctbl[64+1] =
+	"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz@%";
+
+// The inverse of the above: every byte maps to its six-bit value, or to
+// 0x100 if it isn't a part of our code at all.
+struct	SIXBITDECODER {
+	unsigned short	m_tbl[256];
+
+	constexpr SIXBITDECODER(void) : m_tbl() {
+		for(int i=0; i<256; i++)
+			m_tbl[i] = 0x0100;
+		for(int i=0; i<64; i++)
+			m_tbl[(unsigned char)sixbit_enctbl[i]] = i;
+	}
+};
+
+static	constexpr SIXBITDECODER	sixbit_dectbl;
+
 char	TTYBUS::charenc(const int sixbitval) const {
-	if (sixbitval < 10)
-		return '0' + sixbitval;
-	else if (sixbitval < 10+26)
-		return 'A' - 10 + sixbitval;
-	else if (sixbitval < 10+26+26)
-		return 'a' - 10 - 26 + sixbitval;
-	else if (sixbitval == 0x3e)
-		return '@';
-	else if (sixbitval == 0x3f)
-		return '%';
+	if ((sixbitval & (~0x03f))==0)
+		return sixbit_enctbl[sixbitval];
 
 	fprintf(stderr, "INTERNAL ERR: SIXBITVAL isn\'t!!!! sixbitval = %08x\n", sixbitval);
 	assert((sixbitval & (~0x03f))==0);
@@ -117,18 +150,86 @@ char	TTYBUS::charenc(const int sixbitval) const {
 }
 
 unsigned	TTYBUS::chardec(const char b) const {
-	if ((b >= '0')&&(b <= '9'))
-		return b-'0';
-	else if ((b >= 'A')&&(b <= 'Z'))
-		return b-'A'+10;
-	else if ((b >= 'a')&&(b <= 'z'))
-		return b-'a'+36;
-	else if (b == '@')
-		return 0x03e;
-	else if (b == '%')
-		return 0x03f;
-	else
-		return 0x0100; // ERR -- invalid code
+	return sixbit_dectbl.m_tbl[(unsigned char)b];
+}
+
+#ifdef	__SSE2__
+#include <emmintrin.h>
+
+// Convert sixteen characters to their six-bit values at once.  Returns
+// a bit mask with one bit set for every character that isn't a part of
+// our code.
+static	unsigned	sixbits_x16(const char *src, unsigned char *dst) {
+	const	__m128i	c = _mm_loadu_si128((const __m128i *)src);
+	__m128i	isdig, isupr, islwr, isat, ispct, v, valid;
+
+	// Characters with the high bit set compare as negative, and so
+	// will fail every one of these tests
+	isdig = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0'-1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('9'+1)));
+	isupr = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A'-1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('Z'+1)));
+	islwr = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a'-1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('z'+1)));
+	isat  = _mm_cmpeq_epi8(c, _mm_set1_epi8('@'));
+	ispct = _mm_cmpeq_epi8(c, _mm_set1_epi8('%'));
+
+	v = _mm_and_si128(isdig, _mm_sub_epi8(c, _mm_set1_epi8('0')));
+	v = _mm_or_si128(v, _mm_and_si128(isupr,
+			_mm_sub_epi8(c, _mm_set1_epi8('A'-10))));
+	v = _mm_or_si128(v, _mm_and_si128(islwr,
+			_mm_sub_epi8(c, _mm_set1_epi8('a'-36))));
+	v = _mm_or_si128(v, _mm_and_si128(isat,  _mm_set1_epi8(0x3e)));
+	v = _mm_or_si128(v, _mm_and_si128(ispct, _mm_set1_epi8(0x3f)));
+	_mm_storeu_si128((__m128i *)dst, v);
+
+	valid = _mm_or_si128(_mm_or_si128(isdig, isupr),
+			_mm_or_si128(_mm_or_si128(islwr, isat), ispct));
+	return (~_mm_movemask_epi8(valid)) & 0x0ffff;
+}
+#endif
+
+//
+// decode_words
+//
+// Decode n raw data words, as returned by the FPGA, from six characters
+// apiece.  The first character of each carries two data bits in bits
+// 2:1, the rest six bits apiece.  Returns the number of words decoded
+// before the first character not belonging to our code, if any.
+int	TTYBUS::decode_words(const char *str, const int n, uint32 *v) const {
+	int	nw = 0;
+
+#ifdef	__SSE2__
+	// Eight words at a time, forty eight characters, three vectors
+	unsigned char	sb[48];
+	while(nw+8 <= n) {
+		if (sixbits_x16(&str[ 0], &sb[ 0])
+				|sixbits_x16(&str[16], &sb[16])
+				|sixbits_x16(&str[32], &sb[32]))
+			break;	// Let the scalar code find the bad char
+		for(int k=0; k<8; k++) {
+			const	unsigned char *p = &sb[k*6];
+			v[nw+k] = (((p[0]>>1)&0x03)<<30)|(p[1]<<24)|(p[2]<<18)
+				|(p[3]<<12)|(p[4]<<6)|(p[5]);
+		}
+		str += 48; nw += 8;
+	}
+#endif
+
+	for(; nw<n; nw++) {
+		unsigned	d0, d1, d2, d3, d4, d5;
+
+		d0 = chardec(str[0]); d1 = chardec(str[1]);
+		d2 = chardec(str[2]); d3 = chardec(str[3]);
+		d4 = chardec(str[4]); d5 = chardec(str[5]);
+		if ((d0|d1|d2|d3|d4|d5)&(~0x03f))
+			break;
+		v[nw] = (((d0>>1)&0x03)<<30)|(d1<<24)|(d2<<18)
+			|(d3<<12)|(d4<<6)|d5;
+		str += 6;
+	}
+
+	return nw;
 }
 
 int	TTYBUS::lclreadcode(char *buf, int len) {
@@ -170,22 +271,22 @@ void	TTYBUS::bufalloc(int len) {
 
 void	TTYBUS::encode(const int hb, const BUSW val, char *buf) const {
 	buf[0] = charenc( (hb<<2)|((val>>30)&0x03) );
-	buf[1] = charenc( (val>>24)&0x3f);
-	buf[2] = charenc( (val>>18)&0x3f);
-	buf[3] = charenc( (val>>12)&0x3f);
-	buf[4] = charenc( (val>> 6)&0x3f);
-	buf[5] = charenc( (val    )&0x3f);
+	buf[1] = sixbit_enctbl[(val>>24)&0x3f];
+	buf[2] = sixbit_enctbl[(val>>18)&0x3f];
+	buf[3] = sixbit_enctbl[(val>>12)&0x3f];
+	buf[4] = sixbit_enctbl[(val>> 6)&0x3f];
+	buf[5] = sixbit_enctbl[(val    )&0x3f];
 }
 
 unsigned	TTYBUS::decodestr(const char *buf) const {
 	unsigned	r;
 
-	r = chardec(buf[0]) & 0x03;
-	r = (r<<6) | (chardec(buf[1]) & 0x03f);
-	r = (r<<6) | (chardec(buf[2]) & 0x03f);
-	r = (r<<6) | (chardec(buf[3]) & 0x03f);
-	r = (r<<6) | (chardec(buf[4]) & 0x03f);
-	r = (r<<6) | (chardec(buf[5]) & 0x03f);
+	r = (chardec(buf[0]) & 0x03)<<30;
+	r |= (chardec(buf[1]) & 0x03f)<<24;
+	r |= (chardec(buf[2]) & 0x03f)<<18;
+	r |= (chardec(buf[3]) & 0x03f)<<12;
+	r |= (chardec(buf[4]) & 0x03f)<< 6;
+	r |= (chardec(buf[5]) & 0x03f);
 
 	return r;
 }
@@ -207,25 +308,75 @@ void	TTYBUS::writeio(const BUSW a, const BUSW v) {
 	m_lastaddr = a; m_addr_set = true;
 }
 
+char	*TTYBUS::encode_write(const BUSW val, const int p, char *ptr) {
+	int	caddr = 0;
+	unsigned	hash = (val * 0x9e3779b1u) >> (32-LGWRHASH);
+
+	// Let's try compression.  Walk the chain of values sharing our
+	// hash, most recent first, for as long as they remain in the table
+	for(unsigned long seq = m_wrhash[hash]; m_wrseq - seq < 256;
+			seq = m_wrchain[seq & 0x0ff]) {
+		if (m_writetbl[seq & 0x0ff] == val) {
+			caddr = (int)(m_wrseq - seq);
+			break;
+		}
+	}
+
+	/*
+	if (caddr != 0)
+		DBGPRINTF("WR[%08x] = %08x (= TBL[%4x] <= %4x)\n", m_lastaddr, val, caddr, m_wraddr);
+	else
+		DBGPRINTF("WR[%08x] = %08x\n", m_lastaddr, val);
+	*/
+
+	if (caddr != 0) {
+		m_stats.m_wr_tbl++;
+		*ptr++ = charenc( (((caddr>>6)&0x03)<<1) + (p?1:0) + 0x010);
+		*ptr++ = charenc(    caddr    &0x3f    );
+	} else {
+		m_stats.m_wr_raw++;
+		// For testing, let's start just doing this the hard way
+		*ptr++ = charenc( (((val>>30)&0x03)<<1) + (p?1:0) + 0x018);
+		*ptr++ = sixbit_enctbl[(val>>24)&0x3f];
+		*ptr++ = sixbit_enctbl[(val>>18)&0x3f];
+		*ptr++ = sixbit_enctbl[(val>>12)&0x3f];
+		*ptr++ = sixbit_enctbl[(val>> 6)&0x3f];
+		*ptr++ = sixbit_enctbl[(val    )&0x3f];
+
+		m_writetbl[m_wraddr++] = val;
+		m_wraddr &= 0x0ff;
+		if (m_wraddr == 0) {
+			m_wrloaded = true;
+		}
+
+		m_wrchain[m_wrseq & 0x0ff] = m_wrhash[hash];
+		m_wrhash[hash] = m_wrseq++;
+	}
+
+	return ptr;
+}
+
 void	TTYBUS::writev(const BUSW a, const int p, const int len, const BUSW *buf) {
 	char	*ptr;
 	int	nw = 0;
 
-	// We'll never be called with more than MAXWRLEN words to write at once.
-	// This is a configurable option length, set at the top of this file.
-	// (currently set at 32, but subject to change ...)  This is important,
-	// as the return channel *must* be capable of holding at least this many
-	// acknowledgments in its buffer.
-	//
-	// assert(len <= MAXWRLEN);
+	// We send our writes MAXWRLEN words at a time.  Each will be
+	// acknowledged through the FPGA's return FIFO, which must never be
+	// asked to hold more acknowledgements than it has room for.  Rather
+	// than waiting on every chunk, we keep track of how many are still
+	// owed, and only wait once that reaches WRCREDIT.  Until then, writes
+	// of any length stream out as fast as the link will take them.
+
+	rdflush();
 
-	// Allocate a buffer of six bytes per word, one for addr, plus
-	// six more
-	bufalloc((len+2)*6);
+	// Allocate a buffer of six bytes per word of any one chunk, one for
+	// addr, plus six more
+	bufalloc((MAXWRLEN+2)*6);
 
 	DBGPRINTF("WRITEV(%08x,%d,#%d,0x%08x ...)\n", a, p, len, buf[0]);
+	tr(TTYTR_WRITE, a, len);
 	// Encode the address
-	ptr = encode_address(a);
+	ptr = encode_address(a, m_buf);
 	m_lastaddr = a; m_addr_set = true;
 
 	while(nw < len) {
@@ -233,49 +384,16 @@ void	TTYBUS::writev(const BUSW a, const int p, const int len, const BUSW *buf) {
 		if ((unsigned)ln > MAXWRLEN)
 			ln = MAXWRLEN;
 
+		// Don't let the acknowledgements we're owed overflow the
+		// return FIFO
+		if (m_unacked + ln > WRCREDIT)
+			ackwait(WRCREDIT - ln, m_lastaddr);
+
 		DBGPRINTF("WRITEV-SUB(%08x%s,#%d,&buf[%d])\n", a+nw, (p)?"++":"", ln, nw);
 		for(int i=0; i<ln; i++) {
 			BUSW	val = buf[nw+i];
 
-			int	caddr = 0;
-			// Let's try compression
-			for(int i=1; i<256; i++) {
-				unsigned	tstaddr;
-				tstaddr = (m_wraddr - i) & 0x0ff;
-				if ((!m_wrloaded)&&(tstaddr > (unsigned)m_wraddr))
-					break;
-				if (m_writetbl[tstaddr] == val) {
-					caddr = ( m_wraddr- tstaddr ) & 0x0ff;
-					break;
-				}
-			}
-
-		/*
-		if (caddr != 0)
-			DBGPRINTF("WR[%08x] = %08x (= TBL[%4x] <= %4x)\n", m_lastaddr, val, caddr, m_wraddr);
-		else
-			DBGPRINTF("WR[%08x] = %08x\n", m_lastaddr, val);
-		*/
-
-			if (caddr != 0) {
-				*ptr++ = charenc( (((caddr>>6)&0x03)<<1) + (p?1:0) + 0x010);
-				*ptr++ = charenc(    caddr    &0x3f    );
-			
-			} else {
-				// For testing, let's start just doing this the hard way
-				*ptr++ = charenc( (((val>>30)&0x03)<<1) + (p?1:0) + 0x018);
-				*ptr++ = charenc( (val>>24)&0x3f);
-				*ptr++ = charenc( (val>>18)&0x3f);
-				*ptr++ = charenc( (val>>12)&0x3f);
-				*ptr++ = charenc( (val>> 6)&0x3f);
-				*ptr++ = charenc( (val    )&0x3f);
-
-				m_writetbl[m_wraddr++] = val;
-				m_wraddr &= 0x0ff;
-				if (m_wraddr == 0) {
-					m_wrloaded = true;
-				}
-			}
+			ptr = encode_write(val, p, ptr);
 
 			if (p == 1) m_lastaddr+=4;
 		}
@@ -286,10 +404,14 @@ void	TTYBUS::writev(const BUSW a, const int p, const int len, const BUSW *buf) {
 		m_dev->write(m_buf, ptr-m_buf);
 		DBGPRINTF(">> %s\n", m_buf);
 
-		readidle();
-
 		nw += ln;
 		ptr = m_buf;
+
+		// Clear out whatever acknowledgements have come back so far,
+		// but only once enough of them are owed to be worth looking
+		m_unacked += ln;
+		if (m_unacked >= ACKWINDOW)
+			readidle();
 	}
 	DBGPRINTF("WR: LAST ADDRESS LEFT AT %08x\n", m_lastaddr);
 
@@ -303,7 +425,177 @@ void	TTYBUS::writev(const BUSW a, const int p, const int len, const BUSW *buf) {
 	// This would help to clear out the problems between programs, where
 	// one program doesn't finish reading, and the next gets a confusing
 	// message.
-	readidle();
+	//
+	// Since readword() skips acknowledgements anyway, we now leave them
+	// for whatever reads next, or for the next writev() once ACKWINDOW
+	// words have gone by.  A bus error from a write will then be thrown
+	// from there.
+}
+
+//
+// ackdrain
+//
+// Wait on every acknowledgement we're still owed before closing up.  A bus
+// error from one of our last writes is then reported to us, rather than
+// thrown from the first read of whoever uses the bus next.  Since this is
+// called on the way out, it can only be reported, not thrown.
+void	TTYBUS::ackdrain(void) {
+	if (m_unacked == 0)
+		return;
+	try {
+		ackwait(0, m_lastaddr);
+	} catch(BUSERR b) {
+		fprintf(stderr, "BUS ERROR from a write at or before 0x%08x\n",
+			m_lastaddr);
+	}
+	m_unacked = 0;
+}
+
+//
+// ackwait
+//
+// Block until no more than n writes are still waiting on their
+// acknowledgements.  addr is the address to blame, should we find something
+// other than an acknowledgement along the way.
+void	TTYBUS::ackwait(const unsigned n, const BUSW addr) {
+	while(m_unacked > n) {
+		unsigned long	nread;
+		int		left;
+
+		// readidle() may move what's left to the front of our
+		// buffer, so look to how much is left, and to whether any
+		// more was read, rather than to where it is
+		rdfill(1);
+		left  = m_rdlast - m_rdfirst;
+		nread = m_total_nread;
+		readidle();
+		if ((m_rdlast - m_rdfirst == left)&&(m_total_nread == nread)) {
+			// Something other than an ack or idle
+			m_decode_err = true;
+			throw BUSERR(addr);
+		}
+	}
+}
+
+//
+// encode_fill
+//
+// Encode a fill command, asking the FPGA to repeat the last value written
+// len more times.  Fills are only understood by newer FPGA designs.  Older
+// ones will quietly ignore them.
+char	*TTYBUS::encode_fill(const int inc, const unsigned len, char *ptr) {
+	*ptr++ = charenc(0x04 + (inc?1:0));
+	*ptr++ = charenc(0);
+	*ptr++ = charenc((len>>18)&0x3f);
+	*ptr++ = charenc((len>>12)&0x3f);
+	*ptr++ = charenc((len>> 6)&0x3f);
+	*ptr++ = charenc( len     &0x3f);
+	return ptr;
+}
+
+//
+// encode_option
+//
+// Encode an option for the FPGA.  This looks like an empty fill, but with
+// the option number where a fill has zeros.  An FPGA that understands options
+// answers with an option reply, one that only understands fills acknowledges
+// it as an empty fill, and an older one still ignores it.  Either way, no
+// memory is written.
+char	*TTYBUS::encode_option(const int opt, char *ptr) {
+	*ptr++ = charenc(0x04);
+	*ptr++ = charenc(opt & 0x03f);
+	for(int i=0; i<4; i++)
+		*ptr++ = charenc(0);
+	return ptr;
+}
+
+//
+// option_probe
+//
+// Ask the FPGA for its long compression history and for delta codewords, and
+// find out whether or not it obliged.  A read follows, so that we know when
+// any answer would've arrived.  This tells us whether or not the FPGA can
+// fill as well: one that understands fills, but not options, will have
+// acknowledged our options as empty fills before returning the read.
+//
+// The read is of the version register, rather than of whatever our caller
+// is about to read.  That might be a FIFO, or some other register where a
+// read has side effects, and the word we took would then be lost.
+bool	TTYBUS::option_probe(void) {
+	const	BUSW	a = R_VERSION;
+	unsigned long	nacks;
+	char		*ptr;
+
+	ackwait(0, a);
+	nacks = m_nacks;
+
+	ptr = encode_address(a, m_buf);
+	ptr = encode_option(TTYOPT_LONGHIST, ptr);
+	ptr = encode_option(TTYOPT_DELTA, ptr);
+	ptr = readcmd(0, 1, ptr);
+	*ptr++ = '\n'; *ptr = '\0';
+	m_dev->write(m_buf, ptr-m_buf);
+	try {
+		readword();
+	} catch(BUSERR b) {
+		throw BUSERR(a);
+	}
+
+	if (m_opt_cap > 0)
+		m_fill_cap = 1;
+	else {
+		m_opt_cap = -1;
+		m_fill_cap = (m_nacks != nacks) ? 1 : -1;
+	}
+	DBGPRINTF("OPTION-PROBE: options are %ssupported\n", (m_opt_cap>0)?"":"not ");
+	return (m_opt_cap > 0);
+}
+
+void	TTYBUS::fill(const BUSW a, const int len, const BUSW v) {
+	int		nw;
+	char		*ptr;
+
+	// Short fills aren't worth the bother
+	if (len < (int)MAXWRLEN) {
+		DEVBUS::fill(a, len, v);
+		return;
+	}
+
+	rdflush();
+	if (m_fill_cap == 0)
+		option_probe();
+	if (m_fill_cap < 0) {
+		DEVBUS::fill(a, len, v);
+		return;
+	}
+
+	DBGPRINTF("FILL(%08x,#%d,%08x)\n", a, len, v);
+	tr(TTYTR_FILL, a, len);
+
+	// Write the first word normally, so that it becomes the last value
+	// written.  This will leave us at the next address.
+	writev(a, 1, 1, &v);
+
+	// Then ask for it to be repeated over the rest.  The FPGA is busy
+	// while filling, and won't pull any more commands from its input
+	// FIFO, so we send one line at a time and wait for its ack.
+	for(nw=1; nw<len; ) {
+		unsigned	ln = len-nw;
+		if (ln > MAXFILLLEN)
+			ln = MAXFILLLEN;
+		ptr = encode_address(a+(nw<<2), m_buf);
+		ptr = encode_fill(1, ln, ptr);
+		*ptr++ = '\n'; *ptr = '\0';
+		m_dev->write(m_buf, ptr-m_buf);
+		DBGPRINTF(">> %s\n", m_buf);
+		nw += ln;
+		m_lastaddr = a+(nw<<2); m_addr_set = true;
+
+		// Wait for this fill's ack, and so for those of every write
+		// before it as well
+		m_unacked++;
+		ackwait(0, a+(nw<<2));
+	}
 }
 
 void	TTYBUS::writez(const BUSW a, const int len, const BUSW *buf) {
@@ -337,9 +629,9 @@ TTYBUS::BUSW	TTYBUS::readio(const TTYBUS::BUSW a) {
 	return v;
 }
 
-char	*TTYBUS::encode_address(const TTYBUS::BUSW a) {
+char	*TTYBUS::encode_address(const TTYBUS::BUSW a, char *buf) {
 	TTYBUS::BUSW	addr = a>>2;
-	char	*ptr = m_buf;
+	char	*ptr = buf;
 
 	// Double check that we are aligned
 	if ((a&3)!=0) {
@@ -352,7 +644,7 @@ char	*TTYBUS::encode_address(const TTYBUS::BUSW a) {
 	if (m_addr_set) {
 		// Encode a difference address
 		int	diffaddr = (a - m_lastaddr)>>2;
-		ptr = m_buf;
+		ptr = buf;
 		if ((diffaddr >= -32)&&(diffaddr < 32)) {
 			*ptr++ = charenc(0x09);
 			*ptr++ = charenc(diffaddr & 0x03f);
@@ -366,7 +658,7 @@ char	*TTYBUS::encode_address(const TTYBUS::BUSW a) {
 			*ptr++ = charenc((diffaddr>> 6) & 0x03f);
 			*ptr++ = charenc( diffaddr      & 0x03f);
 		} else if ((diffaddr >= -(1<<23))&&(diffaddr < (1<<23))) {
-			*ptr++ = charenc(0x0d);
+			*ptr++ = charenc(0x0f);
 			*ptr++ = charenc((diffaddr>>18) & 0x03f);
 			*ptr++ = charenc((diffaddr>>12) & 0x03f);
 			*ptr++ = charenc((diffaddr>> 6) & 0x03f);
@@ -374,7 +666,7 @@ char	*TTYBUS::encode_address(const TTYBUS::BUSW a) {
 		}
 		*ptr = '\0';
 		DBGPRINTF("DIF-ADDR: (%ld) \'%s\' encodes last_addr(0x%08x) %c %d(0x%08x)\n",
-			ptr-m_buf, m_buf,
+			ptr-buf, buf,
 			m_lastaddr, (diffaddr<0)?'-':'+',
 			diffaddr, diffaddr&0x0ffffffff);
 	}
@@ -384,41 +676,48 @@ char	*TTYBUS::encode_address(const TTYBUS::BUSW a) {
 		// Prefer absolute address encoding over differential encoding,
 		// when both encodings encode the same address, and when both
 		// encode the address in the same number of words
-		if ((addr <= 0x03f)&&((ptr == m_buf)||(ptr >= &m_buf[2]))) {
-			ptr = m_buf;
+		if ((addr <= 0x03f)&&((ptr == buf)||(ptr >= &buf[2]))) {
+			ptr = buf;
 			*ptr++ = charenc(0x08);
 			*ptr++ = charenc(addr);
-		} else if((addr <= 0x0fff)&&((ptr == m_buf)||(ptr >= &m_buf[3]))) {
+		} else if((addr <= 0x0fff)&&((ptr == buf)||(ptr >= &buf[3]))) {
 			// DBGPRINTF("Setting ADDR.3 to %08x\n", addr);
-			ptr = m_buf;
+			ptr = buf;
 			*ptr++ = charenc(0x0a);
 			*ptr++ = charenc((addr>> 6) & 0x03f);
 			*ptr++ = charenc( addr      & 0x03f);
-		} else if((addr <= 0x03ffff)&&((ptr == m_buf)||(ptr >= &m_buf[4]))) {
+		} else if((addr <= 0x03ffff)&&((ptr == buf)||(ptr >= &buf[4]))) {
 			// DBGPRINTF("Setting ADDR.4 to %08x\n", addr);
-			ptr = m_buf;
+			ptr = buf;
 			*ptr++ = charenc(0x0c);
 			*ptr++ = charenc((addr>>12) & 0x03f);
 			*ptr++ = charenc((addr>> 6) & 0x03f);
 			*ptr++ = charenc( addr      & 0x03f);
-		} else if((addr <= 0x0ffffff)&&((ptr == m_buf)||(ptr >= &m_buf[5]))) {
+		} else if((addr <= 0x0ffffff)&&((ptr == buf)||(ptr >= &buf[5]))) {
 			// DBGPRINTF("Setting ADDR.5 to %08x\n", addr);
-			ptr = m_buf;
+			ptr = buf;
 			*ptr++ = charenc(0x0e);
 			*ptr++ = charenc((addr>>18) & 0x03f);
 			*ptr++ = charenc((addr>>12) & 0x03f);
 			*ptr++ = charenc((addr>> 6) & 0x03f);
 			*ptr++ = charenc( addr      & 0x03f);
-		} else if (ptr == m_buf) { // Send our address prior to any read
-			// ptr = m_buf;
+		} else if (ptr == buf) { // Send our address prior to any read
+			// ptr = buf;
 			encode(0, addr, ptr);
 			ptr+=6;
 		}
 	}
 
 	*ptr = '\0';
-	// DBGPRINTF("ADDR-CMD: (%ld) \'%s\'\n", ptr-m_buf, m_buf);
-	m_rdaddr = 0;
+	// DBGPRINTF("ADDR-CMD: (%ld) \'%s\'\n", ptr-buf, buf);
+	if (ptr > buf)
+		m_stats.m_addr_out[ptr-buf]++;
+
+	// Note that we don't reset m_rdaddr here.  The FPGA restarts its
+	// compression table when it sends us an address, and not every
+	// address we send comes back.  Since table references are relative
+	// to the last entry, our table remains in step with the FPGA's
+	// either way.
 
 	return ptr;
 }
@@ -443,38 +742,57 @@ char	*TTYBUS::readcmd(const int inc, const int len, char *buf) {
 }
 
 void	TTYBUS::readv(const TTYBUS::BUSW a, const int inc, const int len, TTYBUS::BUSW *buf) {
-	const	int	READAHEAD = 0, READBLOCK=(MAXRDLEN/2>512)?512:MAXRDLEN/2;
-	int	cmdrd = 0, nread = 0;
-	// TTYBUS::BUSW	addr = a;
+	int	cmdrd = 0, nread = 0, window;
+	// The lengths of the read commands currently in flight, oldest first
+	int	inflight[MAXREADAHEAD], nq = 0, qhead = 0;
 	char	*ptr = m_buf;
 
 	if (len <= 0)
 		return;
+	rdflush();
+	if (m_opt_cap == 0)
+		option_probe();
 	DBGPRINTF("READV(%08x,%d,#%4d)\n", a, inc, len);
+	tr(TTYTR_READ, a, len);
+
+	// Acknowledgements we're still owed share the return FIFO with our
+	// reads, and will all arrive ahead of them
+	if (m_unacked + READBLOCK > (unsigned)RDWINDOW)
+		ackwait(RDWINDOW - READBLOCK, a);
+	window = RDWINDOW - m_unacked;
 
-	ptr = encode_address(a);
+	ptr = encode_address(a, m_buf);
 	try {
-	    while(cmdrd < len) {
-		// ptr = m_buf;
-		do {
+	    while(nread < len) {
+		// Keep up to m_readahead read commands outstanding, so long
+		// as the words they request will fit in the return FIFO
+		while((cmdrd < len)&&(nq < m_readahead)
+				&&(cmdrd-nread < window)) {
 			int	nrd = len-cmdrd;
 			if (nrd > READBLOCK)
 				nrd = READBLOCK;
-			if (cmdrd-nread + nrd>READAHEAD+READBLOCK)
-				nrd = READAHEAD+READBLOCK-(cmdrd-nread);
+			if (cmdrd-nread + nrd > window)
+				nrd = window-(cmdrd-nread);
 			ptr = readcmd(inc, nrd, ptr);
+			inflight[(qhead+nq)%MAXREADAHEAD] = nrd;
+			nq++;
 			cmdrd += nrd;
-		} while((cmdrd-nread < READAHEAD+READBLOCK)&&(cmdrd< len));
+		}
 
-		*ptr++ = '\n'; *ptr = '\0';
-		m_dev->write(m_buf, (ptr-m_buf));
+		if (ptr != m_buf) {
+			*ptr++ = '\n'; *ptr = '\0';
+			m_dev->write(m_buf, (ptr-m_buf));
+			ptr = m_buf;
+		}
 
-		while(nread<(cmdrd-READAHEAD)) {
-			buf[nread++] = readword();
-		} ptr = m_buf;
-	    } // DBGPRINTF("Reading %d words, to end the read\n", len-nread);
-	    while(nread<len) {
-		buf[nread++] = readword();
+		// Drain the oldest command, then go back and issue another
+		// while the rest remain in flight
+		for(int i=0; i<inflight[qhead]; ) {
+			int	nw = readwords(inflight[qhead]-i, &buf[nread]);
+			i += nw; nread += nw;
+		}
+		qhead = (qhead+1)%MAXREADAHEAD;
+		nq--;
 	    }
 	} catch(BUSERR b) {
 		DBGPRINTF("READV::BUSERR trying to read %08x\n", a+((inc)?nread:0));
@@ -490,6 +808,7 @@ void	TTYBUS::readv(const TTYBUS::BUSW a, const int inc, const int len, TTYBUS::B
 	}
 
 	DBGPRINTF("READV::COMPLETE\n");
+	tr(TTYTR_RDDONE, a, len);
 }
 
 void	TTYBUS::readi(const TTYBUS::BUSW a, const int len, TTYBUS::BUSW *buf) {
@@ -500,85 +819,386 @@ void	TTYBUS::readz(const TTYBUS::BUSW a, const int len, TTYBUS::BUSW *buf) {
 	readv(a, 0, len, buf);
 }
 
+//
+// submit_readv
+//
+// Queue up a read, command as much of it as will fit in the FPGA's return
+// FIFO, and then return without waiting for any of it.  The handle we
+// return identifies this read to poll_read() and wait_read().
+int	TTYBUS::submit_readv(const TTYBUS::BUSW a, const int inc, const int len, TTYBUS::BUSW *buf) {
+	RDREQ	*rq;
+	int	id = m_rdnextid++;
+
+	DBGPRINTF("SUBMIT-READV(%08x,%d,#%4d) = %d\n", a, inc, len, id);
+	if (len <= 0)
+		return id;
+
+	// Make room in our queue, if necessary, by finishing the oldest
+	if (m_rdqlen >= MAXPENDING)
+		rdcollect(m_rdq[m_rdqhead].id, true);
+	if ((m_opt_cap == 0)&&(m_rdqlen == 0))
+		option_probe();
+
+	rq = &m_rdq[(m_rdqhead+m_rdqlen)%MAXPENDING];
+	rq->id   = id;
+	rq->addr = a;
+	rq->inc  = inc;
+	rq->len  = len;
+	rq->buf  = buf;
+	rq->ncmd = 0;
+	rq->nrd  = 0;
+	m_rdqlen++;
+	tr(TTYTR_READ, a, len);
+
+	rdissue();
+
+	return id;
+}
+
+int	TTYBUS::submit_readi(const TTYBUS::BUSW a, const int len, TTYBUS::BUSW *buf) {
+	return submit_readv(a, 1, len, buf);
+}
+
+int	TTYBUS::submit_readz(const TTYBUS::BUSW a, const int len, TTYBUS::BUSW *buf) {
+	return submit_readv(a, 0, len, buf);
+}
+
+bool	TTYBUS::poll_read(const int h) {
+	return rdcollect(h, false);
+}
+
+void	TTYBUS::wait_read(const int h) {
+	rdcollect(h, true);
+}
+
+//
+// rdissue
+//
+// Send read commands for our queued reads, in order, for as many words as
+// the return FIFO has room for.  m_lastaddr tracks the address the FPGA
+// will be at once it has processed every command we've sent it--not the
+// address of the last word we've received.  Commands are only ever issued
+// in whole READBLOCKs (or the remainder of a read), lest we dribble out
+// one word at a time as each word is read back.
+void	TTYBUS::rdissue(void) {
+	// Allow for an address codeword to come back with each read
+	const	int	window = RDWINDOW - MAXPENDING;
+	int	outstanding = 0;
+	char	*ptr;
+
+	m_rdfreed = 0;
+	for(int k=0; k<m_rdqlen; k++) {
+		RDREQ	*rq = &m_rdq[(m_rdqhead+k)%MAXPENDING];
+		outstanding += rq->ncmd - rq->nrd;
+	}
+
+	// Acknowledgements we're still owed take up room in the return FIFO
+	// as well.  They'll all arrive ahead of any read we issue now, so if
+	// nothing is yet outstanding, wait on enough of them to make room
+	// for at least one block of reads.
+	if ((outstanding == 0)&&(m_unacked + READBLOCK > (unsigned)window))
+		ackwait(window - READBLOCK, m_lastaddr);
+	outstanding += m_unacked;
+
+	bufalloc(MAXPENDING*12+2);
+	ptr = m_buf;
+	for(int k=0; k<m_rdqlen; k++) {
+		RDREQ	*rq = &m_rdq[(m_rdqhead+k)%MAXPENDING];
+
+		while(rq->ncmd < rq->len) {
+			int	nrd = rq->len - rq->ncmd;
+			if (nrd > READBLOCK)
+				nrd = READBLOCK;
+			if (outstanding + nrd > window)
+				break;
+
+			if (rq->ncmd == 0) {
+				ptr = encode_address(rq->addr, ptr);
+				m_lastaddr = rq->addr; m_addr_set = true;
+			}
+			ptr = readcmd(rq->inc, nrd, ptr);
+			if (rq->inc)
+				m_lastaddr += (nrd<<2);
+			rq->ncmd += nrd;
+			outstanding += nrd;
+		}
+
+		// Later reads must wait on this one's commands
+		if (rq->ncmd < rq->len)
+			break;
+	}
+
+	if (ptr != m_buf) {
+		*ptr++ = '\n'; *ptr = '\0';
+		m_dev->write(m_buf, (ptr-m_buf));
+		DBGPRINTF(">> %s\n", m_buf);
+	}
+}
+
+//
+// rdcollect
+//
+// Read words back into our queued reads, oldest first, until the read with
+// handle h is complete.  If block is false, we stop as soon as nothing more
+// has arrived.  (A codeword that has only partially arrived will still be
+// waited upon, but its remainder is already on its way.)  Returns true once
+// read h is complete.
+bool	TTYBUS::rdcollect(const int h, const bool block) {
+	while((m_rdqlen > 0)&&(m_rdq[m_rdqhead].id <= h)) {
+		RDREQ	*rq = &m_rdq[m_rdqhead];
+
+		if ((!block)&&(!rdready()))
+			return false;
+
+		// readword() tracks the address of each word it receives, yet
+		// m_lastaddr must remain where our commands have left the FPGA
+		BUSW	lastaddr = m_lastaddr;
+		bool	addr_set = m_addr_set;
+		int	nw;
+		try {
+			nw = readwords(rq->len - rq->nrd, &rq->buf[rq->nrd]);
+			rq->nrd += nw;
+		} catch(BUSERR b) {
+			BUSW	erraddr = rq->addr + ((rq->inc)?(rq->nrd<<2):0);
+			DBGPRINTF("RDCOLLECT::BUSERR trying to read %08x\n", erraddr);
+			// Whatever else was in flight is now lost
+			m_rdqlen = 0;
+			m_addr_set = false;
+			throw BUSERR(erraddr);
+		}
+		m_lastaddr = lastaddr; m_addr_set = addr_set;
+
+		if (rq->nrd >= rq->len) {
+			DBGPRINTF("READ %d COMPLETE\n", rq->id);
+			tr(TTYTR_RDDONE, rq->addr, rq->len);
+			m_rdqhead = (m_rdqhead+1)%MAXPENDING;
+			m_rdqlen--;
+		}
+
+		// Every word read makes room for more commands, should any
+		// remain to be sent.  Rather than sending a tiny command for
+		// each, wait until a block's worth of room has opened up--or
+		// until the read we're now collecting has nothing left in
+		// flight.
+		m_rdfreed += nw;
+		if (m_rdqlen > 0) {
+			RDREQ	*hd = &m_rdq[m_rdqhead];
+
+			rq = &m_rdq[(m_rdqhead+m_rdqlen-1)%MAXPENDING];
+			if ((rq->ncmd < rq->len)&&((m_rdfreed >= READBLOCK)
+					||(hd->nrd >= hd->ncmd)))
+				rdissue();
+		}
+	}
+
+	return true;
+}
+
+//
+// rdfill
+//
+// Block until at least n valid characters are waiting in our receive
+// buffer, m_rdbuf[m_rdfirst .. m_rdlast-1].  Rather than reading one
+// character at a time, we ask the device for as much as will fit, so
+// that codewords may then be parsed in place.
+void	TTYBUS::rdfill(const int n) {
+	while(m_rdlast - m_rdfirst < n) {
+		int	nr;
+
+		// Move what little remains to the front of the buffer, so
+		// that the codeword we're after is contiguous
+		if (m_rdfirst > 0) {
+			memmove(m_rdbuf, &m_rdbuf[m_rdfirst], m_rdlast-m_rdfirst);
+			m_rdlast -= m_rdfirst;
+			m_rdfirst = 0;
+		}
+
+		// Only block for what we need, but take along anything else
+		// that's already arrived.  Asking for more than that would
+		// have some devices go and fetch it.
+		nr = m_dev->available();
+		if (nr < n - m_rdlast)
+			nr = n - m_rdlast;
+		if (nr > RDBUFLN - m_rdlast)
+			nr = RDBUFLN - m_rdlast;
+		m_rdlast += lclreadcode(&m_rdbuf[m_rdlast], nr);
+	}
+}
+
+//
+// rdready
+//
+// A non-blocking check for whether or not any characters are waiting to
+// be parsed.  If our buffer is empty, we'll refill it from whatever the
+// device has ready.
+bool	TTYBUS::rdready(void) {
+	int	nr;
+
+	if (m_rdfirst < m_rdlast)
+		return true;
+	// Only ask for what's already there, lest the device go looking for
+	// more
+	nr = m_dev->available();
+	if (nr <= 0) {
+		// Some devices, such as the USB-JTAG port, only bring in what
+		// they're asked for.  A poll() that doesn't wait will ask
+		// them, without blocking on the answer.
+		if (!m_dev->poll(0))
+			return false;
+		nr = m_dev->available();
+		if (nr <= 0)
+			return false;
+	}
+	if (nr > RDBUFLN)
+		nr = RDBUFLN;
+	m_rdfirst = 0;
+	m_rdlast = lclreadcode(m_rdbuf, nr);
+	return (m_rdlast > 0);
+}
+
+void	TTYBUS::transact(BUSOP *ops, const int n) {
+	// Operations per line.  Each may take two codewords on the way in
+	// (an address and a command), and the FPGA's input FIFO only holds
+	// sixty-four, so this keeps us well within it.
+	const	int	OPSPERLINE = MAXWRLEN/2;
+	int	nd = 0;
+
+	if (n <= 0)
+		return;
+	rdflush();
+
+	bufalloc(OPSPERLINE*12+2);
+
+	DBGPRINTF("TRANSACT(#%d)\n", n);
+	tr(TTYTR_TRANSACT, ops[0].addr, n);
+	while(nd < n) {
+		int	ln = n-nd, nrd = 0, nr = 0;
+		char	*ptr = m_buf;
+
+		if (ln > OPSPERLINE)
+			ln = OPSPERLINE;
+
+		// Encode every operation into a single line, each address
+		// encoded relative to the one before it
+		for(int i=nd; i<nd+ln; i++) {
+			ptr = encode_address(ops[i].addr, ptr);
+			m_lastaddr = ops[i].addr; m_addr_set = true;
+			if (ops[i].wr) {
+				ptr = encode_write(ops[i].data, 0, ptr);
+				m_unacked++;
+			} else {
+				ptr = readcmd(0, 1, ptr);
+				nrd++;
+			}
+		}
+		*ptr++ = '\n'; *ptr = '\0';
+		m_dev->write(m_buf, ptr-m_buf);
+		DBGPRINTF(">> %s\n", m_buf);
+
+		// Then pick all of the results up in one pass.  Write acks
+		// are skipped by readword(), and any left over after our last
+		// read are cleared by readidle().  readword() will also track
+		// the addresses the FPGA sends back, but the FPGA's address
+		// is now that of our last operation, read or not.
+		BUSW	lastaddr = m_lastaddr;
+		int	i = nd;
+		try {
+			for(; (nr<nrd)&&(i<nd+ln); i++) {
+				if (!ops[i].wr) {
+					ops[i].data = readword();
+					nr++;
+				}
+			}
+		} catch(BUSERR b) {
+			DBGPRINTF("TRANSACT::BUSERR trying to read %08x\n", ops[i].addr);
+			throw BUSERR(ops[i].addr);
+		}
+		m_lastaddr = lastaddr;
+		readidle();
+
+		nd += ln;
+	}
+
+	DBGPRINTF("TRANSACT::COMPLETE\n");
+}
+
 TTYBUS::BUSW	TTYBUS::readword(void) {
 	TTYBUS::BUSW	val = 0;
-	int		nr;
 	unsigned	sixbits;
+	const char	*cp;
 
 	DBGPRINTF("READ-WORD()\n");
 
 	bool	found_start = false;
 	do {
 		// Blocking read (for now)
-		do {
-			nr = lclreadcode(&m_buf[0], 1);
-		} while (nr < 1);
+		rdfill(1);
+		cp = &m_rdbuf[m_rdfirst];
 
-		sixbits = chardec(m_buf[0]);
+		// Our buffer only ever holds valid codeword characters, so
+		// these are always six bits
+		sixbits = chardec(cp[0]);
 
-		if (sixbits&(~0x03f)) {
-			// Ignore new lines, unprintables, and characters
-			// not a part of our code
-			;
-		} else if (sixbits < 6) {
+		if (sixbits < 6) {
+			m_rdfirst++;
 			switch(sixbits) {
 			case 0:	break; // Idle -- ignore
 			case 1: break; // Idle, but the bus is busy
-			case 2: break; // Write acknowledgement, ignore it here
+			case 2: gotack(); break; // Write ack, ignore it here
 			case 3:
 				m_bus_err = true;
+				m_unacked = 0;
+				// The FPGA forgets our options on reset
+				m_opt_cap = 0;
+				m_stats.m_resets++;
+				tr(TTYTR_RESET, m_lastaddr, 0);
 				throw BUSERR(0);
 				break;
 			case 4:
 				m_interrupt_flag = true;
+				m_stats.m_interrupts++;
+				tr(TTYTR_INT, 0, 0);
 				break;
 			case 5:
 				DBGPRINTF("READWORD::BUSERR (unknown addr)\n");
 				m_bus_err = true;
+				m_unacked = 0;
+				m_stats.m_buserrs++;
+				tr(TTYTR_BUSERR, m_lastaddr, 0);
 				throw BUSERR(0);
 				break;
 			}
 		} else if (0x08 == (sixbits & 0x3c)) { // Set 32-bit address
-			do {
-				nr += lclreadcode(&m_buf[nr], 6-nr);
-			} while (nr < 6);
-
-			val = chardec(m_buf[0]) & 0x03;
-			val = (val<<6) | (chardec(m_buf[1]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[3]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[4]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[5]) & 0x03f);
+			rdfill(6);
+			cp = &m_rdbuf[m_rdfirst];
+			val = decodestr(cp);
+			m_rdfirst += 6;
+			m_stats.m_addr_in_full++;
 
 			m_addr_set = true;
 			m_lastaddr = val<<2;
+			m_rdprev = 0;
 
 			DBGPRINTF("RCVD ADDR: 0x%08x\n", val<<2);
 		} else if (0x0c == (sixbits & 0x03c)) { // Set 32-bit address,compressed
 			int nw = (sixbits & 0x03) + 2;
-			do {
-				nr += lclreadcode(&m_buf[nr], nw-nr);
-			} while (nr < nw);
-
-			if (nw == 2) {
-				val = chardec(m_buf[1]);
-			} else if (nw == 3) {
-				val = chardec(m_buf[1]);
-				val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-			} else if (nw == 4) {
-				val = chardec(m_buf[1]);
-				val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-				val = (val<<6) | (chardec(m_buf[3]) & 0x03f);
-			} else { // if (nw == 5)
-				val = chardec(m_buf[1]);
-				val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-				val = (val<<6) | (chardec(m_buf[3]) & 0x03f);
-				val = (val<<6) | (chardec(m_buf[4]) & 0x03f);
-			}
+			rdfill(nw);
+			cp = &m_rdbuf[m_rdfirst];
+
+			val = 0;
+			for(int i=1; i<nw; i++)
+				val = (val<<6) | chardec(cp[i]);
+			m_rdfirst += nw;
+			m_stats.m_addr_in_short++;
 
 			m_addr_set = true;
 			m_lastaddr = val<<2;
+			m_rdprev = 0;
 			DBGPRINTF("RCVD ADDR: 0x%08x (%d bytes)\n", val<<2, nw+1);
+		} else if (0x34 == (sixbits & 0x03e)) { // Option reply
+			m_rdfirst++;
+			m_opt_cap = 1;
+			DBGPRINTF("RCVD OPTION-REPLY\n");
 		} else
 			found_start = true;
 	} while(!found_start);
@@ -587,71 +1207,159 @@ TTYBUS::BUSW	TTYBUS::readword(void) {
 
 	DBGPRINTF("READ-WORD() -- sixbits = %02x\n", sixbits);
 	if (0x06 == (sixbits & 0x03e)) { // Tbl read, last value
-		rdaddr = (m_rdaddr-1)&0x03ff;
+		m_rdfirst++;
+		rdaddr = (m_rdaddr-1)&(RDTBLLN-1);
 		val = m_readtbl[rdaddr];
+		m_stats.m_rd_last++;
 		m_lastaddr += (sixbits&1)?4:0;
 		DBGPRINTF("READ-WORD() -- repeat last value, %08x, A= %08x\n", val, m_lastaddr);
 	} else if (0x10 == (sixbits & 0x030)) { // Tbl read, up to 521 into past
 		int	idx;
-		do {
-			nr += lclreadcode(&m_buf[nr], 2-nr);
-		} while (nr < 2);
+		rdfill(2);
+		cp = &m_rdbuf[m_rdfirst];
+		m_rdfirst += 2;
 
-		idx = (chardec(m_buf[0])>>1) & 0x07;
-		idx = ((idx<<6) | (chardec(m_buf[1]) & 0x03f)) + 2 + 8;
-		rdaddr = (m_rdaddr-idx)&0x03ff;
+		idx = (chardec(cp[0])>>1) & 0x07;
+		idx = ((idx<<6) | chardec(cp[1])) + 2 + 8;
+		rdaddr = (m_rdaddr-idx)&(RDTBLLN-1);
 		val = m_readtbl[rdaddr];
+		m_stats.m_rd_long++;
 		m_lastaddr += (sixbits&1)?4:0;
 		DBGPRINTF("READ-WORD() -- long table value[%3d], %08x, A=%08x\n", idx, val, m_lastaddr);
+	} else if (0x30 == (sixbits & 0x03c)) { // Tbl read, 522 or more into past
+		int	idx;
+		rdfill(3);
+		cp = &m_rdbuf[m_rdfirst];
+		m_rdfirst += 3;
+
+		idx = (chardec(cp[0])>>1) & 0x01;
+		idx = ((idx<<12) | (chardec(cp[1])<<6) | chardec(cp[2])) + 522;
+		rdaddr = (m_rdaddr-idx)&(RDTBLLN-1);
+		val = m_readtbl[rdaddr];
+		m_stats.m_rd_xtnd++;
+		// Words this far back are added to the table again
+		m_readtbl[m_rdaddr++] = val; m_rdaddr &= (RDTBLLN-1);
+		m_lastaddr += (sixbits&1)?4:0;
+		DBGPRINTF("READ-WORD() -- extended table value[%4d], %08x, A=%08x\n", idx, val, m_lastaddr);
 	} else if (0x20 == (sixbits & 0x030)) { // Tbl read, 2-9 into past
 		int	idx;
+		m_rdfirst++;
 		idx = (((sixbits>>1)&0x07)+2);
-		rdaddr = (m_rdaddr - idx) & 0x03ff;
+		rdaddr = (m_rdaddr - idx) & (RDTBLLN-1);
 		val = m_readtbl[rdaddr];
+		m_stats.m_rd_short++;
 		m_lastaddr += (sixbits&1)?4:0;
 		DBGPRINTF("READ-WORD() -- short table value[%3d], %08x, A=%08x\n", idx, val, m_lastaddr);
 	} else if (0x38 == (sixbits & 0x038)) { // Raw read
-		// DBGPRINTF("READ-WORD() -- RAW-READ, nr = %d\n", nr);
-		do {
-			nr += lclreadcode(&m_buf[nr], 6-nr);
-		} while (nr < 6);
-
-		val = (chardec(m_buf[0])>>1) & 0x03;
-		val = (val<<6) | (chardec(m_buf[1]) & 0x03f);
-		val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-		val = (val<<6) | (chardec(m_buf[3]) & 0x03f);
-		val = (val<<6) | (chardec(m_buf[4]) & 0x03f);
-		val = (val<<6) | (chardec(m_buf[5]) & 0x03f);
-
-		m_readtbl[m_rdaddr++] = val; m_rdaddr &= 0x03ff;
+		rdfill(6);
+		cp = &m_rdbuf[m_rdfirst];
+		m_rdfirst += 6;
+
+		decode_words(cp, 1, &val);
+
+		m_readtbl[m_rdaddr++] = val; m_rdaddr &= (RDTBLLN-1);
+		m_stats.m_rd_raw++;
 		m_lastaddr += (sixbits&1)?4:0;
 		DBGPRINTF("READ-WORD() -- RAW-READ %02x:%02x:%02x:%02x:%02x:%02x -- %08x, A=%08x\n",
-			m_buf[0], m_buf[1], m_buf[2], m_buf[3],
-			m_buf[4], m_buf[5], val, m_lastaddr);
-	} else 
+			cp[0], cp[1], cp[2], cp[3], cp[4], cp[5], val, m_lastaddr);
+	} else if (0x36 == (sixbits & 0x03e)) { // Delta from the last word
+		val = readdelta();
+		m_lastaddr += (sixbits&1)?4:0;
+		DBGPRINTF("READ-WORD() -- delta value, %08x, A=%08x\n", val, m_lastaddr);
+	} else {
+		m_rdfirst++;
 		DBGPRINTF("READ-WORD() -- Unknown character, %02x\n", sixbits);
+		return val;
+	}
 
+	m_rdprev = val;
+	return val;
+}
+
+//
+// readwords
+//
+// Read up to n words into buf, returning how many were read--never fewer
+// than one.  A run of raw codewords already waiting in our buffer is
+// decoded all at once, by decode_words(), rather than one at a time.
+// Anything else goes through readword().
+int	TTYBUS::readwords(const int n, BUSW *buf) {
+	const char	*cp = &m_rdbuf[m_rdfirst];
+	int		nw = 0;
+
+	while((nw < n)&&(m_rdfirst + (nw+1)*6 <= m_rdlast)
+			&&(0x38 == (chardec(cp[nw*6]) & 0x038)))
+		nw++;
+
+	if (nw < 2) {
+		buf[0] = readword();
+		return 1;
+	}
+
+	// Our buffer only ever holds valid codeword characters, so every
+	// one of these words will decode
+	nw = decode_words(cp, nw, buf);
+	for(int i=0; i<nw; i++) {
+		m_readtbl[m_rdaddr++] = buf[i]; m_rdaddr &= (RDTBLLN-1);
+		m_lastaddr += (chardec(cp[i*6])&1)?4:0;
+	}
+	m_rdfirst += nw*6;
+	m_stats.m_rd_raw += nw;
+	m_rdprev = buf[nw-1];
+	DBGPRINTF("READ-WORDS() -- %d RAW-READs, A=%08x\n", nw, m_lastaddr);
+
+	return nw;
+}
+
+//
+// readdelta
+//
+// Decode a delta codeword, which must be next in our buffer.  The two
+// character form carries a five bit signed difference from the last word
+// read.  The four character forms carry either a sixteen bit signed
+// difference, or sixteen bits to be exclusive or'd with the last word.
+TTYBUS::BUSW	TTYBUS::readdelta(void) {
+	BUSW		val;
+	unsigned	c1, d;
+	const char	*cp;
+
+	rdfill(2);
+	cp = &m_rdbuf[m_rdfirst];
+	c1 = chardec(cp[1]);
+	if (c1 & 0x20) {
+		rdfill(4);
+		cp = &m_rdbuf[m_rdfirst];
+		m_rdfirst += 4;
+		d = ((c1&0x0f)<<12) | (chardec(cp[2])<<6) | chardec(cp[3]);
+		if (c1 & 0x10)
+			val = m_rdprev ^ d;
+		else
+			val = m_rdprev + (BUSW)(((int)(d<<16))>>16);
+	} else {
+		m_rdfirst += 2;
+		val = m_rdprev + (BUSW)(((int)(c1<<27))>>27);
+	}
+
+	// Delta coded words go into the table, just as raw words do
+	m_readtbl[m_rdaddr++] = val; m_rdaddr &= (RDTBLLN-1);
+	m_stats.m_rd_delta++;
 	return val;
 }
 
 void	TTYBUS::readidle(void) {
 	TTYBUS::BUSW	val = 0;
-	int		nr;
 	unsigned	sixbits;
 	bool		found_start = false;
+	const char	*cp;
 
 	DBGPRINTF("READ-IDLE()\n");
 
-	while((!found_start)&&(m_dev->available())
-			&&((nr=lclreadcode(&m_buf[0], 1))>0)) {
-		nr = lclreadcode(&m_buf[0], 1);
-		sixbits = chardec(m_buf[0]);
+	while((!found_start)&&(rdready())) {
+		cp = &m_rdbuf[m_rdfirst];
+		sixbits = chardec(cp[0]);
 
-		if (sixbits&(~0x03f)) {
-			// Ignore new lines, unprintables, and characters
-			// not a part of our code
-			;
-		} else if (sixbits < 6) {
+		if (sixbits < 6) {
+			m_rdfirst++;
 			switch(sixbits) {
 			case 0:	break; // Idle -- ignore
 			case 1: break; // Idle, but the bus is busy
@@ -659,33 +1367,40 @@ void	TTYBUS::readidle(void) {
 				// Write acknowledgement, ignore it here
 				// This is one of the big reasons why we are
 				// doing this.
+				gotack();
 				break;
 			case 3:
 				m_bus_err = true;
+				m_unacked = 0;
+				// The FPGA forgets our options on reset
+				m_opt_cap = 0;
+				m_stats.m_resets++;
+				tr(TTYTR_RESET, m_lastaddr, 0);
 				DBGPRINTF("READ-IDLE() - BUSERR\n");
 				throw BUSERR(0);
 				break;
 			case 4:
 				m_interrupt_flag = true;
+				m_stats.m_interrupts++;
+				tr(TTYTR_INT, 0, 0);
 				break;
 			case 5:
 				m_bus_err = true;
+				m_unacked = 0;
+				m_stats.m_buserrs++;
+				tr(TTYTR_BUSERR, m_lastaddr, 0);
 				DBGPRINTF("READ-IDLE() - BUS RESET\n");
 				throw BUSERR(0);
 				break;
 			}
 		} else if (0x08 == (sixbits & 0x3c)) { // Set 32-bit address
-			do {
-				nr += lclreadcode(&m_buf[nr], 6-nr);
-			} while (nr < 6);
-
-			val = chardec(m_buf[0]) & 0x03;
-			val = (val<<6) | (chardec(m_buf[1]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[3]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[4]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[5]) & 0x03f);
+			rdfill(6);
+			cp = &m_rdbuf[m_rdfirst];
+			val = decodestr(cp);
+			m_rdfirst += 6;
+			m_stats.m_addr_in_full++;
 
+			m_rdprev = 0;
 			/* Ignore the address, as we are in readidle();
 			m_addr_set = true;
 			m_lastaddr = val;
@@ -694,31 +1409,25 @@ void	TTYBUS::readidle(void) {
 			DBGPRINTF("RCVD IDLE-ADDR: 0x%08x\n", val);
 		} else if (0x0c == (sixbits & 0x03c)) { // Set 32-bit address,compressed
 			int nw = (sixbits & 0x03) + 2;
-			do {
-				nr += lclreadcode(&m_buf[nr], nw-nr);
-			} while (nr < nw);
-
-			if (nw == 2) {
-				val = chardec(m_buf[1]);
-			} else if (nw == 3) {
-				val = chardec(m_buf[1]);
-				val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-			} else if (nw == 4) {
-				val = chardec(m_buf[1]);
-				val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-				val = (val<<6) | (chardec(m_buf[3]) & 0x03f);
-			} else { // if (nw == 5)
-				val = chardec(m_buf[1]);
-				val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-				val = (val<<6) | (chardec(m_buf[3]) & 0x03f);
-				val = (val<<6) | (chardec(m_buf[4]) & 0x03f);
-			}
+			rdfill(nw);
+			cp = &m_rdbuf[m_rdfirst];
+
+			val = 0;
+			for(int i=1; i<nw; i++)
+				val = (val<<6) | chardec(cp[i]);
+			m_rdfirst += nw;
+			m_stats.m_addr_in_short++;
 
+			m_rdprev = 0;
 			/* Ignore address, we are in readidle();
 			m_addr_set = true;
 			m_lastaddr = val;
 			*/
 			DBGPRINTF("RCVD IDLE-ADDR: 0x%08x (%d bytes)\n", val, nw+1);
+		} else if (0x34 == (sixbits & 0x03e)) { // Option reply
+			m_rdfirst++;
+			m_opt_cap = 1;
+			DBGPRINTF("RCVD IDLE-OPTION-REPLY\n");
 		} else
 			found_start = true;
 	}
@@ -730,77 +1439,123 @@ void	TTYBUS::readidle(void) {
 
 		DBGPRINTF("READ-IDLE()  PANIC! -- sixbits = %02x\n", sixbits);
 		if (0x06 == (sixbits & 0x03e)) { // Tbl read, last value
-			rdaddr = (m_rdaddr-1)&0x03ff;
+			m_rdfirst++;
+			rdaddr = (m_rdaddr-1)&(RDTBLLN-1);
 			val = m_readtbl[rdaddr];
+			m_stats.m_rd_last++;
 			m_lastaddr += (sixbits&1)?4:0;
 			DBGPRINTF("READ-IDLE() -- repeat last value, %08x\n", val);
 		} else if (0x10 == (sixbits & 0x030)) { // Tbl read, up to 521 into past
 			int	idx;
-			do {
-				nr += lclreadcode(&m_buf[nr], 2-nr);
-			} while (nr < 2);
+			rdfill(2);
+			cp = &m_rdbuf[m_rdfirst];
+			m_rdfirst += 2;
 
-			idx = (chardec(m_buf[0])>>1) & 0x07;
-			idx = ((idx<<6) | (chardec(m_buf[1]) & 0x03f)) + 2 + 8;
-			rdaddr = (m_rdaddr-idx)&0x03ff;
+			idx = (chardec(cp[0])>>1) & 0x07;
+			idx = ((idx<<6) | chardec(cp[1])) + 2 + 8;
+			rdaddr = (m_rdaddr-idx)&(RDTBLLN-1);
 			val = m_readtbl[rdaddr];
+			m_stats.m_rd_long++;
 			m_lastaddr += (sixbits&1)?4:0;
 			DBGPRINTF("READ-IDLE() -- long table value[%3d], %08x\n", idx, val);
+		} else if (0x30 == (sixbits & 0x03c)) { // Tbl read, 522+ into past
+			int	idx;
+			rdfill(3);
+			cp = &m_rdbuf[m_rdfirst];
+			m_rdfirst += 3;
+
+			idx = (chardec(cp[0])>>1) & 0x01;
+			idx = ((idx<<12) | (chardec(cp[1])<<6)
+					| chardec(cp[2])) + 522;
+			rdaddr = (m_rdaddr-idx)&(RDTBLLN-1);
+			val = m_readtbl[rdaddr];
+			m_stats.m_rd_xtnd++;
+			// Words this far back are added to the table again
+			m_readtbl[m_rdaddr++] = val; m_rdaddr &= (RDTBLLN-1);
+			m_lastaddr += (sixbits&1)?4:0;
+			DBGPRINTF("READ-IDLE() -- extended table value[%4d], %08x\n", idx, val);
 		} else if (0x20 == (sixbits & 0x030)) { // Tbl read, 2-9 into past
-			rdaddr = (m_rdaddr - (((sixbits>>1)&0x07)+2)) & 0x03ff;
+			m_rdfirst++;
+			rdaddr = (m_rdaddr - (((sixbits>>1)&0x07)+2)) & (RDTBLLN-1);
 			val = m_readtbl[rdaddr];
+			m_stats.m_rd_short++;
 			m_lastaddr += (sixbits&1)?4:0;
 			DBGPRINTF("READ-IDLE() -- short table value[%3d], %08x\n", rdaddr, val);
 		} else if (0x38 == (sixbits & 0x038)) { // Raw read
-			do {
-				nr += lclreadcode(&m_buf[nr], 6-nr);
-			} while (nr < 6);
-	
-			val = (chardec(m_buf[0])>>1) & 0x03;
-			val = (val<<6) | (chardec(m_buf[1]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[2]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[3]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[4]) & 0x03f);
-			val = (val<<6) | (chardec(m_buf[5]) & 0x03f);
-
-			m_readtbl[m_rdaddr++] = val; m_rdaddr &= 0x03ff;
+			rdfill(6);
+			cp = &m_rdbuf[m_rdfirst];
+			m_rdfirst += 6;
+
+			decode_words(cp, 1, &val);
+
+			m_readtbl[m_rdaddr++] = val; m_rdaddr &= (RDTBLLN-1);
+			m_stats.m_rd_raw++;
 			m_lastaddr += (sixbits&1)?4:0;
 			DBGPRINTF("READ-IDLE() -- RAW-READ %02x:%02x:%02x:%02x:%02x:%02x -- %08x\n",
-				m_buf[0], m_buf[1], m_buf[2], m_buf[3],
-				m_buf[4], m_buf[5], val);
-		} else 
+				cp[0], cp[1], cp[2], cp[3], cp[4], cp[5], val);
+		} else if (0x36 == (sixbits & 0x03e)) { // Delta from last word
+			val = readdelta();
+			m_lastaddr += (sixbits&1)?4:0;
+			DBGPRINTF("READ-IDLE() -- delta value, %08x\n", val);
+		} else {
+			m_rdfirst++;
 			DBGPRINTF("READ-IDLE() -- Unknown character, %02x\n", sixbits);
+			return;
+		}
 
+		m_rdprev = val;
 	}
 }
 
 void	TTYBUS::usleep(unsigned ms) {
-	if (m_dev->poll(ms)) {
+	rdflush();
+
+	// Anything already in our receive buffer has arrived before
+	// whatever we might read now, so look there first
+	if ((m_rdfirst >= m_rdlast)&&(m_dev->poll(ms))) {
 		int	nr;
-		nr = m_dev->read(m_buf, 16);
+
+		// Read only what's arrived
+		nr = m_dev->available();
+		if (nr < 1)
+			nr = 1;
+		else if (nr > RDBUFLN)
+			nr = RDBUFLN;
+		nr = m_dev->read(m_rdbuf, nr);
 		if (nr == 0) {
 			// Connection closed, let it drop
 			DBGPRINTF("Connection closed!!\n");
 			m_dev->close();
 			exit(-1);
-		} for(int i=0; i<nr; i++) {
-			if (m_buf[i] == TTYC_INT) {
-				m_interrupt_flag = true;
-				DBGPRINTF("!!!!!!!!!!!!!!!!! ----- INTERRUPT!\n");
-			} else if (m_buf[i] == TTYC_IDLE) {
-				DBGPRINTF("Interface is now idle\n");
-			} else if (m_buf[i] == TTYC_WRITE) {
-			} else if (m_buf[i] == TTYC_RESET) {
-				DBGPRINTF("Bus was RESET!\n");
-			} else if (m_buf[i] == TTYC_ERR) {
-				DBGPRINTF("Bus error\n");
-			} else if (m_buf[i] == TTYC_BUSY) {
-				DBGPRINTF("Interface is ... busy ??\n");
-			}
-			// else if (m_buf[nr] == 'Q')
-			// else if (m_buf[nr] == 'W')
-			// else if (m_buf[nr] == '\n')
 		}
+		m_rdfirst = 0; m_rdlast = nr;
+	}
+
+	for(; m_rdfirst < m_rdlast; m_rdfirst++) {
+		char	ch = m_rdbuf[m_rdfirst];
+		if (ch == TTYC_INT) {
+			m_interrupt_flag = true;
+			m_stats.m_interrupts++;
+			tr(TTYTR_INT, 0, 0);
+			DBGPRINTF("!!!!!!!!!!!!!!!!! ----- INTERRUPT!\n");
+		} else if (ch == TTYC_IDLE) {
+			DBGPRINTF("Interface is now idle\n");
+		} else if (ch == TTYC_WRITE) {
+			gotack();
+		} else if (ch == TTYC_RESET) {
+			DBGPRINTF("Bus was RESET!\n");
+			m_stats.m_resets++;
+			tr(TTYTR_RESET, 0, 0);
+		} else if (ch == TTYC_ERR) {
+			DBGPRINTF("Bus error\n");
+			m_stats.m_buserrs++;
+			tr(TTYTR_BUSERR, 0, 0);
+		} else if (ch == TTYC_BUSY) {
+			DBGPRINTF("Interface is ... busy ??\n");
+		}
+		// else if (ch == 'Q')
+		// else if (ch == 'W')
+		// else if (ch == '\n')
 	}
 }
 
@@ -812,6 +1567,103 @@ void	TTYBUS::wait(void) {
 	} while(!m_interrupt_flag);
 }
 
+TTYBUSSTATS	TTYBUS::stats(void) const {
+	TTYBUSSTATS	st = m_stats;
+
+	// These three are kept elsewhere, and only need to be measured from
+	// wherever they were when our stats were last reset
+	st.m_chars_out = m_dev->m_total_nwrit - m_stats.m_chars_out;
+	st.m_chars_in  = m_total_nread - m_stats.m_chars_in;
+	st.m_acks      = m_nacks - m_stats.m_acks;
+	return st;
+}
+
+void	TTYBUS::reset_stats(void) {
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.m_chars_out = m_dev->m_total_nwrit;
+	m_stats.m_chars_in  = m_total_nread;
+	m_stats.m_acks      = m_nacks;
+}
+
+void	TTYBUS::print_stats(FILE *fp) const {
+	TTYBUSSTATS	st = stats();
+	unsigned long	nwr, nrd, naddr = 0, nca = 0;
+
+	nwr = st.m_wr_raw + st.m_wr_tbl;
+	nrd = st.m_rd_raw + st.m_rd_last + st.m_rd_short + st.m_rd_long
+		+ st.m_rd_xtnd + st.m_rd_delta;
+	for(int i=2; i<7; i++) {
+		naddr += st.m_addr_out[i];
+		nca   += st.m_addr_out[i] * i;
+	}
+
+	fprintf(fp, "Characters:   %lu out, %lu in\n",
+		st.m_chars_out, st.m_chars_in);
+	fprintf(fp, "Words written:%9lu, %5.1f%% from the write table\n",
+		nwr, (nwr) ? 100.0 * st.m_wr_tbl / nwr : 0.0);
+	fprintf(fp, "Words read:   %9lu, %5.1f%% raw, %5.1f%% repeated, "
+			"%5.1f%% short, %5.1f%% long, %5.1f%% extended "
+			"table refs, %5.1f%% deltas\n", nrd,
+		(nrd) ? 100.0 * st.m_rd_raw   / nrd : 0.0,
+		(nrd) ? 100.0 * st.m_rd_last  / nrd : 0.0,
+		(nrd) ? 100.0 * st.m_rd_short / nrd : 0.0,
+		(nrd) ? 100.0 * st.m_rd_long  / nrd : 0.0,
+		(nrd) ? 100.0 * st.m_rd_xtnd  / nrd : 0.0,
+		(nrd) ? 100.0 * st.m_rd_delta / nrd : 0.0);
+	fprintf(fp, "Addresses out:%9lu, %.2f chars each "
+			"(%lu/%lu/%lu/%lu/%lu of 2/3/4/5/6 chars)\n", naddr,
+		(naddr) ? (double)nca / naddr : 0.0,
+		st.m_addr_out[2], st.m_addr_out[3], st.m_addr_out[4],
+		st.m_addr_out[5], st.m_addr_out[6]);
+	fprintf(fp, "Addresses in: %9lu full, %lu compressed\n",
+		st.m_addr_in_full, st.m_addr_in_short);
+	fprintf(fp, "Acks %lu, bus errors %lu, resets %lu, interrupts %lu\n",
+		st.m_acks, st.m_buserrs, st.m_resets, st.m_interrupts);
+}
+
+void	TTYBUS::trace(unsigned n) {
+	delete[] m_trace;
+	m_trace = NULL;
+	m_trlen = 0;
+	m_trpos = 0;
+
+	if (n == 0)
+		return;
+	for(m_trlen = 1; m_trlen < n; m_trlen <<= 1)
+		;
+	m_trace = new TTYTRACE[m_trlen];
+}
+
+void	TTYBUS::trlog(const unsigned op, const BUSW a, const unsigned len) {
+	TTYTRACE	*t = &m_trace[m_trpos++ & (m_trlen-1)];
+	struct	timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t->m_ns   = ts.tv_sec * 1000000000ul + ts.tv_nsec;
+	t->m_addr = a;
+	t->m_len  = len;
+	t->m_op   = op;
+}
+
+void	TTYBUS::dump_trace(FILE *fp) const {
+	static	const char *opname[] = { "WRITE", "READ", "RDDONE", "FILL",
+		"TRANSACT", "BUSERR", "RESET", "INT" };
+	unsigned long	first, t0;
+
+	if (!m_trace)
+		return;
+	first = (m_trpos > m_trlen) ? m_trpos - m_trlen : 0;
+	if (first >= m_trpos)
+		return;
+	t0 = m_trace[first & (m_trlen-1)].m_ns;
+	for(unsigned long k=first; k<m_trpos; k++) {
+		const TTYTRACE	*t = &m_trace[k & (m_trlen-1)];
+		fprintf(fp, "%12.3f us  %-8s %08x %6u\n",
+			(t->m_ns - t0) / 1e3, opname[t->m_op & 7],
+			t->m_addr, t->m_len);
+	}
+}
+
 // TTYBUS:  3503421 ~= 3.3 MB, stopwatch = 1:18.5 seconds, vs 53.8 secs
 //	If you issue two 512 word reads at once, time drops to 41.6 secs.
 // PORTBUS: 6408320 ~= 6.1 MB, ... 26% improvement, 53 seconds real time
@@ -50,17 +50,70 @@
 #ifndef	TTYBUS_H
 #define	TTYBUS_H
 
+#include <stdio.h>
+#include <string.h>
+
 #include "llcomms.h"
 #include "devbus.h"
 
 #define	RDBUFLN	2048
+#define	MAXREADAHEAD	8
+#define	MAXPENDING	8
+#define	LGWRHASH	10
+// The size of our copy of the FPGA's read compression table.  This must be a
+// power of two, at least as large as the FPGA's table.
+#define	RDTBLLN		8192
+// Options that may be sent to the FPGA, see TTYBUS::encode_option()
+#define	TTYOPT_SHORTHIST	1
+#define	TTYOPT_LONGHIST		2
+#define	TTYOPT_DELTA		3
+
+// Counters kept by every TTYBUS, describing how well the link is being used.
+// See TTYBUS::stats().
+typedef	struct	{
+	// Characters sent to, and received from, the device
+	unsigned long	m_chars_out, m_chars_in;
+	// Words written in full, or as references to the write table
+	unsigned long	m_wr_raw, m_wr_tbl;
+	// Words read in full, or as references to the read table: to the
+	// last word read, to one two to nine words back, to one from ten
+	// to 521 words back, or (in long history mode) further back still.
+	// Then, words read as a difference from the last word read.
+	unsigned long	m_rd_raw, m_rd_last, m_rd_short, m_rd_long, m_rd_xtnd,
+			m_rd_delta;
+	// Addresses sent, by their length in characters, two through six
+	unsigned long	m_addr_out[7];
+	// Addresses received, in full or compressed
+	unsigned long	m_addr_in_full, m_addr_in_short;
+	// Write acknowledgements, bus errors, bus resets, and interrupts
+	unsigned long	m_acks, m_buserrs, m_resets, m_interrupts;
+} TTYBUSSTATS;
+
+// One entry in TTYBUS's optional trace, see TTYBUS::trace()
+typedef	struct	{
+	unsigned long	m_ns;	// CLOCK_MONOTONIC time stamp, in nanoseconds
+	unsigned	m_addr;	// Address of the first word, if any
+	unsigned	m_len;	// Number of words, or of operations
+	unsigned	m_op;	// One of the TTYTR_* values below
+} TTYTRACE;
+
+#define	TTYTR_WRITE	0
+#define	TTYTR_READ	1	// A read was submitted
+#define	TTYTR_RDDONE	2	// ... and has now completed
+#define	TTYTR_FILL	3
+#define	TTYTR_TRANSACT	4
+#define	TTYTR_BUSERR	5
+#define	TTYTR_RESET	6
+#define	TTYTR_INT	7
 
 class	TTYBUS : public DEVBUS {
 public:
 	unsigned long	m_total_nread;
 private:
 	LLCOMMSI	*m_dev;
-	static	const	unsigned MAXRDLEN, MAXWRLEN;
+	static	const	unsigned MAXRDLEN, MAXWRLEN, RDFIFOLEN;
+	static	const	int	READBLOCK, RDWINDOW;
+	static	const	unsigned MAXFILLLEN, ACKWINDOW, WRCREDIT;
 
 	bool	m_interrupt_flag, m_decode_err, m_addr_set, m_bus_err;
 	unsigned int	m_lastaddr;
@@ -70,7 +123,49 @@ private:
 
 	bool	m_wrloaded;
 	int	m_rdaddr, m_wraddr;
-	BUSW	m_readtbl[1024], m_writetbl[512];
+	int	m_readahead;
+	// Write acknowledgements received
+	unsigned long	m_nacks;
+	// Writes (and fills) whose acknowledgements are still on their way
+	unsigned	m_unacked;
+	// Whether or not the FPGA understands fill commands: zero if we
+	// haven't yet asked, positive if it does, negative if not
+	int	m_fill_cap;
+	// Likewise, whether or not it understands options, and so can be
+	// asked for its long compression history and delta codewords
+	int	m_opt_cap;
+	BUSW	m_readtbl[RDTBLLN], m_writetbl[512];
+	// The last word read, from which delta codewords are taken.  This
+	// is zero following any address.
+	BUSW	m_rdprev;
+
+	// An index into m_writetbl, by value.  Every word placed into the
+	// table is given a sequence number, m_wrseq, so that its slot is
+	// given by its sequence number modulo 256.  m_wrhash[] holds the most
+	// recent sequence number of any value hashing to each bucket, and
+	// m_wrchain[] the one before that for each slot.  Sequence numbers
+	// more than 255 back are no longer within the table.
+	unsigned long	m_wrseq, m_wrhash[1<<LGWRHASH], m_wrchain[256];
+
+	// Our counters.  The character and acknowledgement counts here hold
+	// only where those counts stood when we started, see stats().
+	TTYBUSSTATS	m_stats;
+
+	// Our trace, if any: a ring of m_trlen entries (a power of two),
+	// m_trpos being the count of entries ever recorded
+	TTYTRACE	*m_trace;
+	unsigned	m_trlen;
+	unsigned long	m_trpos;
+
+	// Reads submitted, but not yet complete, oldest first
+	typedef	struct	{
+		int	id, inc, len, ncmd, nrd;
+		BUSW	addr, *buf;
+	} RDREQ;
+	RDREQ	m_rdq[MAXPENDING];
+	int	m_rdqhead, m_rdqlen, m_rdnextid;
+	// Words read back since rdissue() last looked for room to send more
+	int	m_rdfreed;
 
 	void	init(void) {
 		m_total_nread = 0;
@@ -86,46 +181,123 @@ private:
 		m_rdbuf = new char[RDBUFLN];
 
 		m_rdaddr = m_wraddr = 0;
+		m_rdprev = 0;
+		m_readahead = 2;
+		m_nacks = 0;
+		m_unacked = 0;
+		m_fill_cap = 0;
+		m_opt_cap = 0;
+
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_stats.m_chars_out = m_dev->m_total_nwrit;
+		m_trace = NULL;
+		m_trlen = 0;
+		m_trpos = 0;
+
+		m_wrseq = 256;
+		for(int i=0; i<(1<<LGWRHASH); i++)
+			m_wrhash[i] = 0;
+
+		m_rdqhead = m_rdqlen = 0;
+		m_rdnextid = 0;
+		m_rdfreed = 0;
 	}
 
 	char	charenc(const int sixbitval) const;
 	unsigned chardec(const char b) const;
 	void	encode(const int fbits, const BUSW v, char *buf) const;
 	unsigned decodestr(const char *buf) const;
+	int	decode_words(const char *str, const int n, uint32 *v) const;
 	int	decodehex(const char hx) const;
 	void	bufalloc(int len);
 	BUSW	readword(void); // Reads a word value from the bus
+	int	readwords(const int n, BUSW *buf);
+	BUSW	readdelta(void);
 	void	readv(const BUSW a, const int inc, const int len, BUSW *buf);
 	void	writev(const BUSW a, const int p, const int len, const BUSW *buf);
 	void	readidle(void);
+	void	gotack(void) { m_nacks++; if (m_unacked > 0) m_unacked--; }
+	// Add an entry to our trace.  This is all that's left of it when
+	// tracing is off.
+	void	tr(const unsigned op, const BUSW a, const unsigned len) {
+		if (m_trace) trlog(op, a, len); }
+	void	trlog(const unsigned op, const BUSW a, const unsigned len);
+	void	ackwait(const unsigned n, const BUSW addr);
+	void	ackdrain(void);
 
 	int	lclread(char *buf, int len);
 	int	lclreadcode(char *buf, int len);
-	char	*encode_address(const BUSW a);
+	void	rdfill(const int n);
+	bool	rdready(void);
+	char	*encode_address(const BUSW a, char *buf);
+	char	*encode_write(const BUSW val, const int p, char *ptr);
 	char	*readcmd(const int inc, const int len, char *buf);
+	char	*encode_fill(const int inc, const unsigned len, char *ptr);
+	char	*encode_option(const int opt, char *ptr);
+	bool	option_probe(void);
+	int	submit_readv(const BUSW a, const int inc, const int len,
+			BUSW *buf);
+	void	rdissue(void);
+	bool	rdcollect(const int h, const bool block);
+	void	rdflush(void) { if (m_rdqlen > 0) rdcollect(m_rdnextid, true); }
 public:
 	TTYBUS(LLCOMMSI *comms) : m_dev(comms) { init(); }
 	virtual	~TTYBUS(void) {
+		ackdrain();
 		m_dev->close();
 		if (m_buf) { delete[] m_buf; m_buf = NULL; }
-		delete m_rdbuf; m_rdbuf = NULL;
+		delete[] m_rdbuf; m_rdbuf = NULL;
+		delete[] m_trace;
 		delete	m_dev;
 	}
 
 	void	kill(void) { m_dev->close(); }
-	void	close(void) {	m_dev->close(); }
+	void	close(void) {	ackdrain(); m_dev->close(); }
 	void	writeio(const BUSW a, const BUSW v);
 	BUSW	readio(const BUSW a);
 	void	readi( const BUSW a, const int len, BUSW *buf);
 	void	readz( const BUSW a, const int len, BUSW *buf);
 	void	writei(const BUSW a, const int len, const BUSW *buf);
 	void	writez(const BUSW a, const int len, const BUSW *buf);
+	void	transact(BUSOP *ops, const int n);
+	void	fill(const BUSW a, const int len, const BUSW v);
+	int	submit_readi(const BUSW a, const int len, BUSW *buf);
+	int	submit_readz(const BUSW a, const int len, BUSW *buf);
+	bool	poll_read(const int h);
+	void	wait_read(const int h);
 	bool	poll(void) { return m_interrupt_flag; };
 	void	usleep(unsigned msec); // Sleep until interrupt
 	void	wait(void); // Sleep until interrupt
 	bool	bus_err(void) const { return m_bus_err; };
 	void	reset_err(void) { m_bus_err = false; }
 	void	clear(void) { m_interrupt_flag = false; }
+
+	// Set the number of read commands readv() may keep outstanding at
+	// once.  One reproduces the old request-then-drain behavior.
+	void	set_readahead(int n) {
+		m_readahead = (n < 1) ? 1 : (n > MAXREADAHEAD) ? MAXREADAHEAD:n;
+	}
+	int	readahead(void) const { return m_readahead; }
+
+	// The fraction of words written that were sent as write table
+	// references, rather than in full
+	double	wrtbl_hitrate(void) const {
+		unsigned long	n = m_stats.m_wr_tbl + m_stats.m_wr_raw;
+		return (n) ? (double)m_stats.m_wr_tbl / (double)n : 0.0;
+	}
+
+	// Our counters, since we started or since they were last reset
+	TTYBUSSTATS	stats(void) const;
+	void	reset_stats(void);
+	// Print the counters out, in a form a person might read
+	void	print_stats(FILE *fp) const;
+
+	// Keep a trace of the last n bus operations (rounded up to a power
+	// of two), or stop tracing if n is zero.  Tracing costs little more
+	// than a time stamp per operation, and nothing at all when it is off.
+	void	trace(unsigned n);
+	// Write the trace out, oldest entry first
+	void	dump_trace(FILE *fp) const;
 };
 
 #endif
@@ -42,6 +42,9 @@
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 // #include <usb.h>
 
 #include <libusb.h>
@@ -98,13 +101,13 @@ static const	char	TX_DR_BITS[TX_DR_LEN] = {
 };
 
 //
-//	TMS: 
-//	
+// A request for TDO bits, sent while holding TDI high (idle).  The bit
+// count, in bytes one through four, is filled in by request_tdo().
+//
 #define	REQ_RX_LEN	6
 static const	char	REQ_RX_BITS[REQ_RX_LEN] = {
 	JTAG_CMD,
-	(const char)((USB_PKTLEN-REQ_RX_LEN)*8), // bits-requested
-	0,0,0,	// Also clocks, higher order bits
+	0,0,0,0,	// bits-requested, low order byte first
 	GET_TDO_MASK|TDI_VAL_MASK, // flags:TDI is kept low here, so no TDI flag
 	// No data given, since there's no info to send or receive
 	// Leave the result in shift-DR mode
@@ -185,12 +188,231 @@ USBI::USBI(void) {
 	}
 
 	// Initialize our read FIFO
-	m_rbeg = m_rend = 0;
+	m_rbuf.reset();
+	m_lastrx = 0;
+	m_overflow = 0;
+
+	// From here on, all transfers are asynchronous.  Start a thread to
+	// run libusb's event handling, and so to complete them for us.
+	m_nout = m_nin = m_nin_bytes = 0;
+	m_rxreq = JTAG_MINRX;
+	for(int i=0; i<USB_NXFRS; i++)
+		m_xfrs[i] = NULL;
+	pthread_mutex_init(&m_lock, NULL);
+	pthread_cond_init(&m_cond, NULL);
+	m_running = true;
+	if (0 != pthread_create(&m_event_thread, NULL, event_loop, this)) {
+		fprintf(stderr, "Could not start USB event thread\n");
+		perror("O/S Err:");
+
+		libusb_close(m_xula_usb_device);
+		libusb_exit(m_usb_context);
+		exit(-1);
+	}
 
 	flush_read();
 }
 
+void	*USBI::event_loop(void *vp) {
+	USBI	*usbi = (USBI *)vp;
+
+	while(usbi->m_running) {
+		struct	timeval	tv;
+
+		tv.tv_sec  = 0;
+		tv.tv_usec = 50000;
+		libusb_handle_events_timeout_completed(usbi->m_usb_context,
+			&tv, NULL);
+	}
+
+	return NULL;
+}
+
+void	USBI::out_callback(struct libusb_transfer *xfr) {
+	USBI	*usbi = (USBI *)xfr->user_data;
+
+	if (xfr->status == LIBUSB_TRANSFER_CANCELLED) {
+		// close() gave up on it
+	} else if ((xfr->status != LIBUSB_TRANSFER_COMPLETED)
+			||(xfr->actual_length != xfr->length)) {
+		printf("WRITE::(buf, %d) -- ERR\n", xfr->length);
+		printf("status = %d, actual_length = %d (!= %d requested)\n",
+			xfr->status, xfr->actual_length, xfr->length);
+	}
+
+	pthread_mutex_lock(&usbi->m_lock);
+	usbi->m_nout--;
+	usbi->release(xfr);
+	pthread_cond_broadcast(&usbi->m_cond);
+	pthread_mutex_unlock(&usbi->m_lock);
+
+	delete[] xfr->buffer;
+	libusb_free_transfer(xfr);
+}
+
+void	USBI::in_callback(struct libusb_transfer *xfr) {
+	USBI	*usbi = (USBI *)xfr->user_data;
+	int	nv = 0;
+
+	// Push the data onto our FIFO before taking the lock, so that anyone
+	// woken up below will find it there.  A transfer that timed out may
+	// still have brought some data with it.
+	if (((xfr->status == LIBUSB_TRANSFER_COMPLETED)
+			||(xfr->status == LIBUSB_TRANSFER_TIMED_OUT))
+			&&(xfr->actual_length > 0)) {
+		if (DEBUG) {
+			printf("RAW-READ() -> %d Read\n", xfr->actual_length);
+			for(int i=0; i<xfr->actual_length; i++)
+				printf("%02x ", xfr->buffer[i] & 0x0ff);
+			printf("\n");
+		}
+		nv = usbi->push_fifo((char *)xfr->buffer, xfr->actual_length);
+	} else if ((xfr->status != LIBUSB_TRANSFER_COMPLETED)
+			&&(xfr->status != LIBUSB_TRANSFER_TIMED_OUT)
+			&&(xfr->status != LIBUSB_TRANSFER_CANCELLED))
+		printf("Some error took place in receiving, status = %d\n",
+			xfr->status);
+
+	pthread_mutex_lock(&usbi->m_lock);
+	usbi->m_nin--;
+	usbi->m_nin_bytes -= xfr->length;
+	usbi->release(xfr);
+	// Only ask for more at a time while what we ask for comes back full
+	if (nv < xfr->length)
+		usbi->m_rxreq = JTAG_MINRX;
+	else if (usbi->m_rxreq < JTAG_MAXLEN * USB_NXFRS/2)
+		usbi->m_rxreq *= 2;
+	pthread_cond_broadcast(&usbi->m_cond);
+	pthread_mutex_unlock(&usbi->m_lock);
+
+	delete[] xfr->buffer;
+	libusb_free_transfer(xfr);
+}
+
+//
+// submit
+//
+// Queue a bulk transfer, either OUT (data is the buffer to send) or IN
+// (data is NULL, and we ask for exactly len bytes).  An OUT buffer must
+// have been allocated with new[], and becomes the transfer's own, to be
+// freed once it completes, so that it needn't be copied again here.  If
+// USB_NXFRS transfers are already outstanding, we'll wait here for one of
+// them to complete.  Every transfer is given USB_XFRTIMEOUT to do so.
+//
+// (A caller's own timeout is too short for this.  Transfers to any one
+// endpoint complete in order, so a TDO request timing out while queued
+// behind others would leave its read holding up the IN endpoint until
+// USB_XFRTIMEOUT anyway.)
+void	USBI::submit(unsigned char ep, unsigned char *data, int len) {
+	struct	libusb_transfer	*xfr;
+	bool	in = (ep & 0x80) != 0;
+	int	r;
+
+	if (in)
+		data = new unsigned char[len];
+
+	xfr = libusb_alloc_transfer(0);
+	libusb_fill_bulk_transfer(xfr, m_xula_usb_device, ep, data, len,
+		(in) ? in_callback : out_callback, this, USB_XFRTIMEOUT);
+
+	pthread_mutex_lock(&m_lock);
+	while(m_nout + m_nin >= USB_NXFRS)
+		pthread_cond_wait(&m_cond, &m_lock);
+	if (in) {
+		m_nin++;
+		m_nin_bytes += len;
+	} else
+		m_nout++;
+	for(int i=0; i<USB_NXFRS; i++) {
+		if (!m_xfrs[i]) {
+			m_xfrs[i] = xfr;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&m_lock);
+
+	r = libusb_submit_transfer(xfr);
+	if (r != 0) {
+		printf("Could not submit USB transfer, r = %d\n", r);
+		perror("O/S Err");
+		exit(-2);
+	}
+}
+
+//
+// submit_cmd
+//
+// Send a JTAG command to the device, and queue a read for the rxlen bytes
+// of TDO bits it will send back in return.  Since libusb completes
+// transfers to any one endpoint in the order they were submitted, the
+// returned data will land in our FIFO in the order the commands were
+// issued.
+void	USBI::submit_cmd(unsigned char *cmd, int len, int rxlen) {
+	submit(XESS_ENDPOINT_OUT, cmd, len);
+	submit(XESS_ENDPOINT_IN, NULL, rxlen);
+}
+
+//
+// request_tdo
+//
+// Ask for len bytes of TDO, while shifting idle (all ones) into the device
+void	USBI::request_tdo(int len) {
+	unsigned char	*req = new unsigned char[REQ_RX_LEN];
+	unsigned	nbits = len * 8;
+
+	memcpy(req, REQ_RX_BITS, REQ_RX_LEN);
+	req[1] = (nbits    ) & 0x0ff;
+	req[2] = (nbits>> 8) & 0x0ff;
+	req[3] = (nbits>>16) & 0x0ff;
+	req[4] = (nbits>>24) & 0x0ff;
+	submit_cmd(req, REQ_RX_LEN, len);
+}
+
+//
+// release
+//
+// Forget a transfer that has completed.  Called with m_lock held.
+void	USBI::release(struct libusb_transfer *xfr) {
+	for(int i=0; i<USB_NXFRS; i++) {
+		if (m_xfrs[i] == xfr) {
+			m_xfrs[i] = NULL;
+			break;
+		}
+	}
+}
+
 void	USBI::close(void) {
+	if (!m_xula_usb_device)
+		return;
+
+	// Give anything still in flight a chance to complete.  Cancel
+	// whatever doesn't, and then wait for those cancellations to
+	// complete as well, since until then libusb may still use their
+	// buffers and our device.  Only then shut down our event thread.
+	{
+		struct	timespec	ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += 1;
+
+		pthread_mutex_lock(&m_lock);
+		while(m_nout + m_nin > 0) {
+			if (pthread_cond_timedwait(&m_cond, &m_lock, &ts)
+					== ETIMEDOUT)
+				break;
+		}
+
+		if (m_nout + m_nin > 0) {
+			for(int i=0; i<USB_NXFRS; i++)
+				if (m_xfrs[i])
+					libusb_cancel_transfer(m_xfrs[i]);
+			while(m_nout + m_nin > 0)
+				pthread_cond_wait(&m_cond, &m_lock);
+		}
+		pthread_mutex_unlock(&m_lock);
+	}
+	m_running = false;
+	pthread_join(m_event_thread, NULL);
+
 	// Release our interface
 	if (0 != libusb_release_interface(m_xula_usb_device, XESS_INTERFACE)) {
 		fprintf(stderr, "Could not release interface\n");
@@ -203,65 +425,38 @@ void	USBI::close(void) {
 
 	// And then close our device with
 	libusb_close(m_xula_usb_device);
+	m_xula_usb_device = NULL;
 
 	// And just before exiting, we free our USB context
 	libusb_exit(m_usb_context);
 }
 
 void	USBI::write(char *buf, int len) {
-	int	r, actual_length;
-
-	if (len >= USB_PKTLEN) {
-		const int	nv = USB_PKTLEN/2-1;
-		for(int pos=0; pos<len; pos+=nv)
-			write(&buf[pos], (len-pos>nv)?(nv):len-pos);
+	if (len > JTAG_MAXLEN) {
+		for(int pos=0; pos<len; pos+=JTAG_MAXLEN)
+			write(&buf[pos], (len-pos>JTAG_MAXLEN)
+				? JTAG_MAXLEN : len-pos);
 	} else {
-		memset(m_txbuf, 0, len+6);
-		m_txbuf[0] = JTAG_CMD;
-		m_txbuf[1] = len * 8;
-		m_txbuf[2] = 0;
-		m_txbuf[3] = 0;
-		m_txbuf[4] = 0;
-		m_txbuf[5] = PUT_TDI_MASK | GET_TDO_MASK;
-
-		for(int i=0; i<len; i++)
-			m_txbuf[6+i] = buf[i];
+		unsigned	nbits = len * 8;
+		// Build the command within the transfer's own buffer, so
+		// that our data is copied only this once
+		unsigned char	*cmd = new unsigned char[len+6];
+
+		m_total_nwrit += len;
+
+		cmd[0] = JTAG_CMD;
+		cmd[1] = (nbits    ) & 0x0ff;
+		cmd[2] = (nbits>> 8) & 0x0ff;
+		cmd[3] = (nbits>>16) & 0x0ff;
+		cmd[4] = (nbits>>24) & 0x0ff;
+		cmd[5] = PUT_TDI_MASK | GET_TDO_MASK;
+
+		memcpy(&cmd[6], buf, len);
 		// printf("WRITE::(buf=%*s, %d)\n", len, buf, len);
-		r = libusb_bulk_transfer(m_xula_usb_device, XESS_ENDPOINT_OUT,
-			(unsigned char*)m_txbuf, len+6, &actual_length, 0);
-		if ((r!=0)||(actual_length != len+6)) {
-			printf("WRITE::(buf, %d) -- ERR\n", len+6);
-			printf("r = %d, actual_length = %d (!= %d requested)\n", r,
-				actual_length, len+6);
-
-			if (r == -7) {
-				r = libusb_bulk_transfer(m_xula_usb_device,
-					XESS_ENDPOINT_OUT,
-					(unsigned char*)m_txbuf, len+6,
-					&actual_length, 2);
-				if ((r!=0)||(actual_length != len+6)) {
-					printf("WRITE::(buf, %d) -- ERR\n", len+6);
-					printf("r = %d, actual_length = %d (!= %d requested)\n", r,
-						actual_length, len+6);
-					perror("O/S Err");
-
-					exit(-2);
-				}
-			} else {
-				perror("O/S Err");
-				exit(-2);
-			}
-		}
 
-		// Try to read back however many bytes we can
-		r = libusb_bulk_transfer(m_xula_usb_device, XESS_ENDPOINT_IN,
-			(unsigned char*)m_rxbuf, USB_PKTLEN, &actual_length, 20);
-		if ((r==0)&&(actual_length > 0)) {
-			push_fifo(m_rxbuf, actual_length);
-		} else {
-			printf("Some error took place in receiving\n");
-			perror("O/S Err");
-		}
+		// Queue the write, and a read of whatever comes back, without
+		// waiting on either
+		submit_cmd(cmd, len+6, len);
 	}
 }
 
@@ -272,7 +467,7 @@ int	USBI::read(char *buf, int len) {
 int	USBI::read(char *buf, int len, int timeout_ms) {
 	int	left = len, nr=0;
 
-	// printf("USBI::read(%d) (FIFO is %d-%d)\n", len, m_rend, m_rbeg);
+	// printf("USBI::read(%d) (FIFO holds %d)\n", len, m_rbuf.avail());
 	nr = pop_fifo(buf, left);
 	left -= nr;
 	
@@ -287,159 +482,159 @@ int	USBI::read(char *buf, int len, int timeout_ms) {
 	}
 
 	// printf("READ %d characters (%d req, %d left)\n", len-left, len, left);
+	m_total_nread += len-left;
 	return len-left;
 }
 
 void	USBI::raw_read(const int clen, int timeout_ms) {
-	int	avail = (m_rbeg - m_rend)&(RCV_BUFMASK), actual_length;
-	int	len = clen;
-	if (len > RCV_BUFMASK-avail)
-		len = RCV_BUFMASK-avail;
-	if (len > 26)
-		len = 26;
-
-	if (DEBUG) printf("USBI::RAW-READ(%d, was %d)\n", len, clen);
-	memcpy(m_txbuf, REQ_RX_BITS, REQ_RX_LEN);
-
-	// I have chased process hangs to this line, but have no more
-	// information than that somewhere within libusb_bulk_transfer,
-	// libusb_handle_events_completed,
-	// libusb_handle_events_timeout_completed, ?, poll(), there seems
-	// to be a bug.
+	int	avail, want, room, nreq = 0;
+
+	// How many bytes of TDO should we have in flight?  m_rxreq, rather
+	// than however many our caller wants, since we can't know how many
+	// the device has to send.  Less what's already on its way, so long
+	// as our FIFO has room for all of it.
+	avail = m_rbuf.avail();
+	pthread_mutex_lock(&m_lock);
+	room  = USB_RINGLN - avail - m_nin_bytes;
+	want  = m_rxreq - m_nin_bytes;
+	if ((want < JTAG_MINRX)&&(m_nin == 0))
+		want = JTAG_MINRX;
+	if (want > room)
+		want = room;
+	pthread_mutex_unlock(&m_lock);
+
+	if (DEBUG) printf("USBI::RAW-READ(%d, requesting %d)\n", clen, want);
+	while((want > 0)&&(nreq < USB_NXFRS/2)) {
+		int	ln = (want > JTAG_MAXLEN) ? JTAG_MAXLEN : want;
+		request_tdo(ln);
+		want -= ln;
+		nreq++;
+	}
+
+	// Now wait for something to show up, for everything we've asked for
+	// to come back empty, or for timeout_ms to pass.
 	//
-	// I'm not certain if the bug is in the Linux kernel, or in the 
-	// Xess tools.  I will note that, when a followup attempt is made
-	// to read from the device, previously unread data may still get dumped
-	// to it.  Therefore, be careful to clear the device upon starting
-	// any process.
+	// I have chased process hangs to libusb_bulk_transfer in the past,
+	// somewhere within libusb_handle_events_completed,
+	// libusb_handle_events_timeout_completed, ?, poll().  I'm not certain
+	// if the bug is in the Linux kernel, or in the Xess tools.  I will
+	// note that, when a followup attempt is made to read from the
+	// device, previously unread data may still get dumped to it.
+	// Therefore, be careful to clear the device upon starting any process.
 	//
-	if(DEBUG) { printf("["); fflush(stdout); }
-	int r = libusb_bulk_transfer(m_xula_usb_device, XESS_ENDPOINT_OUT,
-		(unsigned char *)m_txbuf, REQ_RX_LEN, &actual_length,
-		timeout_ms);
-	if(DEBUG) { printf("]"); fflush(stdout); }
-
-	if ((r==0)&&(actual_length == REQ_RX_LEN)) {
-	} else if (r == -7) {
-		// Nothing to read in the timeout provided
-		// We'll have to request this data again ... later
-		return;
-	} else {
-		printf("READ(WRITE,READ-REQ) -- ERR\n");
-		printf("r = %d, actual_length = %d (!= %d requested)\n", r,
-			actual_length, len+6);
-		perror("O/S Err");
-		exit(-2);
-	}
+	{
+		struct	timespec	ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec  += timeout_ms / 1000;
+		ts.tv_nsec += (timeout_ms % 1000) * 1000000l;
+		if (ts.tv_nsec >= 1000000000l) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000l;
+		}
 
-	// Try to read back however many bytes we can
-	r = libusb_bulk_transfer(m_xula_usb_device, XESS_ENDPOINT_IN,
-		(unsigned char *)m_rxbuf, USB_PKTLEN, &actual_length, 0);
-	if ((r==0)&&(actual_length > 0)) {
-		if (DEBUG) {
-			printf("RAW-READ() -> %d Read\n", actual_length);
-			for(int i=0; i<actual_length; i++)
-				printf("%02x ", m_rxbuf[i] & 0x0ff);
-			printf("\n");
+		pthread_mutex_lock(&m_lock);
+		while((m_rbuf.avail() == 0)&&(m_nin > 0)) {
+			if (pthread_cond_timedwait(&m_cond, &m_lock, &ts)
+					== ETIMEDOUT)
+				break;
 		}
-		push_fifo(m_rxbuf, actual_length);
-	} else if (r == -7) {
-		// Nothing to read in the timeout provided
-		// Return, adding nothing to our FIFO
-	} else {
-		printf("Some error took place in receiving\n");
-		perror("O/S Err");
+		pthread_mutex_unlock(&m_lock);
 	}
 
 	// fprintf(stderr, "\tUSBI::RAW-READ() -- COMPLETE (%d avail)\n",
-		// (m_rbeg-m_rend)&(RCV_BUFMASK));
+		// m_rbuf.avail());
 }
 
 void	USBI::flush_read(void) {
-	while(poll(4)) {
-		m_rbeg = m_rend = 0;
-	}
+	while(poll(4))
+		m_rbuf.drain();
 }
 
-void	USBI::push_fifo(char *buf, int len) {
-	char	last = 0;
-	char	*sptr = buf;
+//
+// push_fifo
+//
+// Called from m_event_thread only.  Drops any repeated idle or control
+// bytes, and any all-ones bytes, compacting what's left in place within buf
+// before pushing it onto our FIFO.  Returns the number of bytes kept.
+int	USBI::push_fifo(char *buf, int len) {
+	char	last = m_lastrx;
+	int	nv = 0, nw;
 
-	// printf("Pushing %d items onto FIFO (%d - %d)\n", len, m_rend, m_rbeg);
-	if (m_rbeg != m_rend)
-		last = m_rbuf[m_rend];
 	if (DEBUG)
 		printf("\tPushing:");
 	for(int i=0; i<len; i++) {
-		char v = *sptr++;
+		char v = buf[i];
 		if (((v & 0x80)||((unsigned char)v < 0x10))&&(v == last)) {
 			// printf("\tSkipping: %02x\n", v & 0x0ff);
 		} else if ((unsigned char)v == 0x0ff) {
 		} else {
-			m_rbuf[m_rbeg] = v;
-			m_rbeg = (m_rbeg+1)&(RCV_BUFMASK);
+			buf[nv++] = v;
 			if (DEBUG)
 				printf(" %02x", v & 0x0ff);
 		} last = v;
 	} if (DEBUG) printf("\n");
+	m_lastrx = last;
+
+	nw = m_rbuf.write(buf, nv);
+	if (nw < nv) {
+		// This should never happen, since raw_read() won't ask for more
+		// than will fit.  Still, if it does, say so.
+		m_overflow += nv - nw;
+		fprintf(stderr, "USBI: Receive FIFO overflow, %lu bytes lost\n",
+			m_overflow);
+	}
+
+	return nv;
 }
 
 int	USBI::pop_fifo(char *buf, int len) {
-	int	avail = (m_rbeg - m_rend)&(RCV_BUFMASK);
-	int	left = len;
-	int	nr = 0;
-
-	// printf("Attempting to pop %d items from FIFO (%d - %d)\n",
-	//		len, m_rend, m_rbeg);
-	while((avail > 0)&&(left > 0)) {
-		int ln = RCV_BUFLEN-m_rend;
-		if (ln > left)
-			ln = left;
-		if (ln > avail)
-			ln = avail;
-		memcpy(&buf[len-left], &m_rbuf[m_rend], ln);
-		left   -= ln;
-		avail  -= ln;
-		m_rend  = (m_rend + ln)&(RCV_BUFMASK);
-		nr     += ln;
-
-		if (DEBUG) {
-			printf("P:");
-			for(int i=0; i<ln; i++)
-				printf("%02x ", buf[len-left-ln+i]);
-		}
-	} if (DEBUG) printf("\n");
-
-	/*
-	if (nr > 0)
-		printf("\tPopped %d items, buf[0] = %02x (%d - %d)\n",
-			nr, buf[0], m_rend, m_rbeg);
-	else
-		printf("\tPopped nothing, %d - %d\n", m_rend, m_rbeg);
-	*/
+	int	nr;
+
+	nr = m_rbuf.read(buf, len);
+	if (DEBUG) {
+		printf("P:");
+		for(int i=0; i<nr; i++)
+			printf("%02x ", buf[i]);
+		printf("\n");
+	}
 
 	return nr;
 }
 
 bool	USBI::poll(unsigned ms) {
-	int	avail = (m_rbeg-m_rend)&(RCV_BUFMASK);
+	int	avail;
+	char	first, last;
 	bool	r = true;
 
 	// printf("POLL request\n");
 
-	if ((avail < 2)&&((avail<1)||(m_rbuf[m_rend]&0x80)||(m_rbuf[m_rend]<0x10))) {
+	avail = m_rbuf.avail();
+	first = (avail > 0) ? m_rbuf.peek(0) : 0;
+
+	if ((avail < 2)&&((avail<1)||(first&0x80)||(first<0x10))) {
 		raw_read(4,ms);
-		avail = (m_rbeg-m_rend)&(RCV_BUFMASK);
+
+		avail = m_rbuf.avail();
+		last  = (avail > 0) ? m_rbuf.peek(avail-1) : 0;
 		// printf("%d availabe\n", avail);
 
-		char	v = (m_rbuf[(m_rbeg-1)&(RCV_BUFMASK)]);
-		while(((v&0x80)==0)&&((unsigned)v>=0x10)&&(avail < RCV_BUFMASK-32)) {
+		// Keep reading until we get to the end of a line
+		while(((last&0x80)==0)&&((unsigned)last>=0x10)&&(avail < USB_RINGLN-32)) {
+			int	lastavail = avail;
 			raw_read(26,ms);
-			avail = (m_rbeg-m_rend)&(RCV_BUFMASK);
+
+			avail = m_rbuf.avail();
+			if (avail == lastavail) {
+				// Nothing more is coming, for now
+				break;
+			}
+			last  = m_rbuf.peek(avail-1);
 		}
+
+		first = (avail > 0) ? m_rbuf.peek(0) : 0;
 		if (avail < 1)
 			r = false;
-		else if ((avail==1)&&((m_rbuf[m_rend]&0x80)||(m_rbuf[m_rend]<0x10)))
+		else if ((avail==1)&&((first&0x80)||(first<0x10)))
 			r = false;
 	}
 
@@ -448,11 +643,15 @@ bool	USBI::poll(unsigned ms) {
 }
 
 int	USBI::available(void) {
-	int	avail = (m_rbeg-m_rend)&(RCV_BUFMASK);
+	int	avail;
+	char	first;
+
+	avail = m_rbuf.avail();
+	first = (avail > 0) ? m_rbuf.peek(0) : 0;
 
 	if (avail > 1)
 		return avail;
-	else if ((avail == 1)&&((m_rbuf[m_rend]&0x80)||(m_rbuf[m_rend]<0x10)))
+	else if ((avail == 1)&&((first&0x80)||(first<0x10)))
 		return 1;
 	else
 		return 0;
@@ -45,6 +45,7 @@
 #define	USBI_H
 
 #include <libusb.h>
+#include <pthread.h>
 
 #define	VENDOR_ID		0x04d8
 #define	PRODUCT_ID		0x0ff8c
@@ -62,23 +63,70 @@
 //
 // #define	USER1_INSTR	0x02	// a SIX bit two
 #define	USB_PKTLEN	32
-#define	RCV_BUFLEN	512
-#define	RCV_BUFMASK	(RCV_BUFLEN-1)
+// The most data bytes we'll shift through in any one JTAG_CMD.  The command
+// carries a 32-bit bit count, so this is limited only by what we care to
+// buffer.
+#define	JTAG_MAXLEN	480
+// The least we'll ask for when requesting TDO bits while reading
+#define	JTAG_MINRX	26
+#define	RCV_BUFLEN	4096
+// The size of the FIFO holding bytes received from the device, but not yet
+// read.  This must be a power of two.
+#define	USB_RINGLN	65536
+// The maximum number of USB transfers, in either direction, that we'll
+// keep queued with libusb at any one time
+#define	USB_NXFRS	16
+// How long, in milliseconds, any one transfer may take before we give up on
+// it, so that a wedged device can't hold all of our transfers forever.
+// Callers waiting on a read give up after their own, shorter, timeouts.
+#define	USB_XFRTIMEOUT	1000
 
 #include "llcomms.h"
+#include "spscring.h"
 
 class	USBI : public LLCOMMSI { // USB Interface
 private:
-	char	m_rbuf[RCV_BUFLEN];
-	char	m_txbuf[2*USB_PKTLEN], m_rxbuf[2*USB_PKTLEN];
-	int	m_rbeg, m_rend;
+	SPSCRING<USB_RINGLN>	m_rbuf;
+	char	m_rxbuf[2*USB_PKTLEN];
+	// The last byte m_event_thread received, and a count of any bytes it
+	// had to throw away for lack of room in m_rbuf
+	char		m_lastrx;
+	unsigned long	m_overflow;
 
 	libusb_context		*m_usb_context;
 	libusb_device		**m_usb_dev_list;
 	libusb_device_handle	*m_xula_usb_device;
 
+	// Asynchronous transfer state.  Transfers are submitted by the
+	// caller, and completed by m_event_thread, which pushes any TDO
+	// data it receives onto m_rbuf.  That thread is the FIFO's only
+	// producer, and the caller its only consumer, so the FIFO needs no
+	// lock.  m_lock protects only the counts of transfers outstanding,
+	// m_cond signals completions.
+	pthread_t	m_event_thread;
+	pthread_mutex_t	m_lock;
+	pthread_cond_t	m_cond;
+	volatile bool	m_running;
+	int	m_nout, m_nin, m_nin_bytes;
+	// Every transfer outstanding, so that close() can cancel any that
+	// won't complete.  Empty slots are NULL.
+	struct libusb_transfer	*m_xfrs[USB_NXFRS];
+	// The most TDO we'll ask for ahead of the caller needing it.  This
+	// starts at JTAG_MINRX, and doubles each time a read comes back full
+	// of data, so that long reads keep the device busy while a single
+	// word's read shifts no more than it must.
+	int	m_rxreq;
+
+	static	void	*event_loop(void *usbi);
+	static	void	LIBUSB_CALL out_callback(struct libusb_transfer *xfr);
+	static	void	LIBUSB_CALL in_callback(struct libusb_transfer *xfr);
+	void	submit(unsigned char ep, unsigned char *data, int len);
+	void	submit_cmd(unsigned char *cmd, int len, int rxlen);
+	void	request_tdo(int len);
+	void	release(struct libusb_transfer *xfr);
+
 	virtual	int	pop_fifo(char *buf, int len);
-	virtual	void	push_fifo(char *buf, int len);
+	virtual	int	push_fifo(char *buf, int len);
 	virtual	void	raw_read(int len, int timeout_ms);
 	virtual	void	flush_read(void);
 
@@ -107,12 +107,9 @@ public:
 
 	void	read_raw_state(void) {
 		m_state.m_valid = false;
-		for(int i=0; i<16; i++)
-			m_state.m_sR[i] = cmd_read(i);
-		for(int i=0; i<16; i++)
-			m_state.m_uR[i] = cmd_read(i+16);
-		for(int i=0; i<20; i++)
-			m_state.m_p[i]  = cmd_read(i+32);
+		cmd_readv( 0, 16, m_state.m_sR);
+		cmd_readv(16, 16, m_state.m_uR);
+		cmd_readv(32, 20, m_state.m_p);
 
 		m_state.m_gie = (m_state.m_sR[14] & 0x020);
 		m_state.m_pc  = (m_state.m_gie) ? (m_state.m_uR[15]):(m_state.m_sR[15]);
@@ -170,12 +167,32 @@ public:
 				m_state.m_smem[i].m_valid = true;
 			else
 				m_state.m_smem[i].m_valid = false;
-			if (m_state.m_smem[i].m_valid)
+		}
+
+		// Read the stack all at once if we can.  If any of it fails,
+		// go back and find out which one(s), one at a time
+		{
+			BUSOP	ops[5];
+			int	nops = 0;
+
+			for(int i=0; i<5; i++)
+				if (m_state.m_smem[i].m_valid)
+					ops[nops++] = BUSOP(false, m_state.m_smem[i].m_a);
 			try {
-				m_state.m_smem[i].m_d = readio(m_state.m_smem[i].m_a);
-				m_state.m_smem[i].m_valid = true;
+				m_fpga->transact(ops, nops);
+				for(int i=0, k=0; i<5; i++)
+					if (m_state.m_smem[i].m_valid)
+						m_state.m_smem[i].m_d = ops[k++].data;
 			} catch(BUSERR be) {
-				m_state.m_smem[i].m_valid = false;
+				for(int i=0; i<5; i++) {
+					if (m_state.m_smem[i].m_valid)
+					try {
+						m_state.m_smem[i].m_d = readio(m_state.m_smem[i].m_a);
+						m_state.m_smem[i].m_valid = true;
+					} catch(BUSERR be) {
+						m_state.m_smem[i].m_valid = false;
+					}
+				}
 			}
 		}
 		m_state.m_valid = true;
@@ -193,6 +210,19 @@ public:
 		return m_fpga->writei(a, len, buf); }
 	void	writez(const BUSW a, const int len, const BUSW *buf) {
 		return m_fpga->writez(a, len, buf); }
+	void	transact(BUSOP *ops, const int n) {
+		return m_fpga->transact(ops, n); }
+	void	fill(const BUSW a, const int len, const BUSW v) {
+		m_fpga->fill(a, len, v); }
+	void	fill_pattern(const BUSW a, const int len, const BUSW *pat,
+			const int plen) {
+		m_fpga->fill_pattern(a, len, pat, plen); }
+	int	submit_readi(const BUSW a, const int len, BUSW *buf) {
+		return m_fpga->submit_readi(a, len, buf); }
+	int	submit_readz(const BUSW a, const int len, BUSW *buf) {
+		return m_fpga->submit_readz(a, len, buf); }
+	bool	poll_read(const int h) { return m_fpga->poll_read(h); }
+	void	wait_read(const int h) { m_fpga->wait_read(h); }
 	bool	poll(void) { return m_fpga->poll(); }
 	void	usleep(unsigned ms) { m_fpga->usleep(ms); }
 	void	wait(void) { m_fpga->wait(); }
@@ -302,6 +332,29 @@ public:
 		return readio(R_ZIPDATA);
 	}
 
+	// Read n consecutive CPU registers, starting at a, in a single bus
+	// transaction.  Any register the CPU wasn't yet ready to give us is
+	// then read again the slow way.
+	void	cmd_readv(unsigned int a, int n, unsigned int *v) {
+		BUSOP	*ops = new BUSOP[3*n];
+
+		for(int i=0; i<n; i++) {
+			ops[3*i  ] = BUSOP(true,  R_ZIPCTRL, CMD_HALT|((a+i)&0x3f));
+			ops[3*i+1] = BUSOP(false, R_ZIPCTRL);
+			ops[3*i+2] = BUSOP(false, R_ZIPDATA);
+		}
+		m_fpga->transact(ops, 3*n);
+
+		for(int i=0; i<n; i++) {
+			if (ops[3*i+1].data & CPU_STALL)
+				v[i] = ops[3*i+2].data;
+			else
+				v[i] = cmd_read(a+i);
+		}
+
+		delete[] ops;
+	}
+
 	void	cmd_write(unsigned int a, int v) {
 		int errcount = 0;
 		unsigned int	s;
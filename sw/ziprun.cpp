@@ -61,8 +61,12 @@
 FPGA	*m_fpga;
 
 void	usage(void) {
-	printf("USAGE: ziprun [-hpuv] <zip-program-file>\n");
+	printf("USAGE: ziprun [-cfhpuv] <zip-program-file>\n");
 	printf("\n"
+"\t-c\tVerify the flash by having the board calculate a CRC of it,\n"
+"\t\trather than by reading it all back\n"
+"\t-f\tProgram the flash in high speed mode, reading back each\n"
+"\t\terase or write without waiting for it to complete\n"
 "\t-h\tDisplay this usage statement\n"
 "\t-p [PORT]\tConnect to the XuLA device across a network access\n"
 "\t\tconnection using port PORT, rather than attempting a USB\n"
@@ -80,7 +84,8 @@ const unsigned
 
 int main(int argc, char **argv) {
 	int		skp=0, port = FPGAPORT;
-	bool		use_usb = true, start_when_finished = false, verbose = false;
+	bool		use_usb = true, start_when_finished = false, verbose = false,
+			high_speed = false, crc_verify = false;
 	unsigned	entry = RAMBASE;
 	FLASHDRVR	*flash = NULL;
 	const char	*bitfile = NULL, *altbitfile = NULL, *execfile = NULL;
@@ -94,6 +99,12 @@ int main(int argc, char **argv) {
 	for(int argn=0; argn<argc-skp; argn++) {
 		if (argv[argn+skp][0] == '-') {
 			switch(argv[argn+skp][1]) {
+			case 'c':
+				crc_verify = true;
+				break;
+			case 'f':
+				high_speed = true;
+				break;
 			case 'h':
 				usage();
 				exit(EXIT_SUCCESS);
@@ -215,6 +226,8 @@ int main(int argc, char **argv) {
 	}
 
 	flash = new FLASHDRVR(m_fpga);
+	flash->set_high_speed(high_speed);
+	flash->set_crc_verify(crc_verify);
 
 	if ((execfile)||(bitfile)) try {
 		ELFSECTION	**secpp = NULL, *secp;
@@ -84,6 +84,29 @@ unsigned int	cmd_read(FPGA *fpga, int r) {
 	} return fpga->readio(R_ZIPDATA);
 }
 
+// Read n consecutive CPU registers, starting at r, in a single bus
+// transaction, falling back to cmd_read() for any register the CPU
+// wasn't yet ready to give us
+void	cmd_readv(FPGA *fpga, int r, int n, unsigned int *v) {
+	BUSOP	*ops = new BUSOP[3*n];
+
+	for(int i=0; i<n; i++) {
+		ops[3*i  ] = BUSOP(true,  R_ZIPCTRL, CPU_HALT|((r+i)&0x03f));
+		ops[3*i+1] = BUSOP(false, R_ZIPCTRL);
+		ops[3*i+2] = BUSOP(false, R_ZIPDATA);
+	}
+	fpga->transact(ops, 3*n);
+
+	for(int i=0; i<n; i++) {
+		if (ops[3*i+1].data & CPU_STALL)
+			v[i] = ops[3*i+2].data;
+		else
+			v[i] = cmd_read(fpga, r+i);
+	}
+
+	delete[] ops;
+}
+
 void	usage(void) {
 	printf("USAGE: zipstate\n");
 }
@@ -132,21 +155,24 @@ int main(int argc, char **argv) {
 		// if (v & 0x0800) printf("CLR-CACHE ");
 		printf("\n");
 	} else {
+		unsigned int	regs[32];
+
 		printf("Reading the long-state ...\n");
+		cmd_readv(m_fpga, 0, 32, regs);
 		for(int i=0; i<14; i++) {
-			printf("sR%-2d: 0x%08x ", i, cmd_read(m_fpga, i));
+			printf("sR%-2d: 0x%08x ", i, regs[i]);
 			if ((i&3)==3)
 				printf("\n");
-		} printf("sCC : 0x%08x ", cmd_read(m_fpga, 14));
-		printf("sPC : 0x%08x ", cmd_read(m_fpga, 15));
+		} printf("sCC : 0x%08x ", regs[14]);
+		printf("sPC : 0x%08x ", regs[15]);
 		printf("\n\n"); 
 
 		for(int i=0; i<14; i++) {
-			printf("uR%-2d: 0x%08x ", i, cmd_read(m_fpga, i+16));
+			printf("uR%-2d: 0x%08x ", i, regs[i+16]);
 			if ((i&3)==3)
 				printf("\n");
-		} printf("uCC : 0x%08x ", cmd_read(m_fpga, 14+16));
-		printf("uPC : 0x%08x ", cmd_read(m_fpga, 15+16));
+		} printf("uCC : 0x%08x ", regs[14+16]);
+		printf("uPC : 0x%08x ", regs[15+16]);
 		printf("\n\n"); 
 	}
 